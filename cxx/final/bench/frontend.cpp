@@ -0,0 +1,521 @@
+// frontend benchmarks every stage of the compiler on generated programs of the
+// given sizes and prints the results as JSON. The programs are valid for
+// grammar.txt and mix declarations, display statements, assignments of nested
+// expressions and comments in a configurable ratio. Programs are parsed both
+// by the table parser and by the recursive-descent parser generated from
+// grammar.txt, which must build the same tree.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "../descent.hpp"
+#include "../lib/grammar.hpp"
+#include "../lib/lexer.hpp"
+#include "../lib/parser.hpp"
+#include "../lib/transpile.hpp"
+
+namespace {
+// allocations counts the calls to operator new, which is replaced below so
+// that the bench can tell how much parsing allocates.
+std::atomic<size_t> allocations{0};
+
+// mix is the relative number of each kind of item in a generated program.
+struct mix {
+  double decls = 1;     // declared variables
+  double displays = 2;  // display statements
+  double exprs = 6;     // assignments of nested expressions
+  double comments = 1;  // comment lines
+  int depth = 3;        // how deep parentheses nest in expressions
+};
+
+// generator generates programs of about a given size. The same seed always
+// generates the same programs.
+class generator {
+ public:
+  generator(mix m, uint32_t seed)
+      : depth(m.depth),
+        rng(seed),
+        kinds({m.decls, m.displays, m.exprs, m.comments}) {}
+
+  std::string generate(size_t size) {
+    std::string body;
+    body.reserve(size + 4096);
+
+    // Declarations come first in a program, so the body is generated before
+    // them and they are inserted in front of it once they are all known.
+    declared = 1;
+    size_t prefix = 64;  // the rest of the program besides its body
+    bool anyStatement = false;
+    while (prefix + body.size() < size || !anyStatement) {
+      switch (kinds(rng)) {
+        case DECL:
+          prefix += variable(declared++).size() + 3;
+          break;
+        case DISPLAY:
+          body += "  display ( ";
+          if (rng() % 2 == 0) {
+            body += "\"value\" , ";
+          }
+          body += variable(rng() % declared);
+          body += " ) ;\n";
+          anyStatement = true;
+          break;
+        case EXPR:
+          body += "  ";
+          body += variable(rng() % declared);
+          body += " = ";
+          expression(body, depth);
+          body += " ;\n";
+          anyStatement = true;
+          break;
+        case COMMENT:
+          body += "  // comment ";
+          body += std::to_string(rng() % 1000);
+          body += "\n";
+          break;
+      }
+    }
+
+    std::string head = "program p ;\nvar\n  ";
+    for (size_t i = 0; i < declared; i++) {
+      head += variable(i);
+      if (i + 1 == declared) {
+        head += " : integer ;\n";
+      } else {
+        head += i % 10 == 9 ? " ,\n  " : " , ";
+      }
+    }
+    head += "begin\n";
+    body.insert(0, head);
+    body += "end.\n";
+    return body;
+  }
+
+ private:
+  enum kind { DECL, DISPLAY, EXPR, COMMENT };
+
+  int depth;
+  std::mt19937 rng;
+  std::discrete_distribution<int> kinds;
+  size_t declared = 0;
+
+  // variable returns the name of the i-th variable.
+  static std::string variable(size_t i) {
+    return "pqrs"[i % 4] + std::to_string(i / 4);
+  }
+
+  void expression(std::string& out, int depth) {
+    static const char* const ops[] = {" + ", " - ", " * ", " / "};
+    const int factors = 1 + rng() % 3;
+    for (int i = 0; i < factors; i++) {
+      if (i > 0) {
+        out += ops[rng() % 4];
+      }
+      factor(out, depth);
+    }
+  }
+
+  void factor(std::string& out, int depth) {
+    switch (rng() % 3) {
+      case 0:
+        if (depth > 0) {
+          out += "( ";
+          expression(out, depth - 1);
+          out += " )";
+          return;
+        }
+        [[fallthrough]];
+      case 1:
+        out += variable(rng() % declared);
+        return;
+      default:
+        out += std::to_string(rng() % 1000);
+        return;
+    }
+  }
+};
+
+// sameTree returns true if both tokens have the same children.
+bool sameTree(const Parser::Token& a, const Parser::Token& b) {
+  if (a.type != b.type || a.children.size() != b.children.size()) {
+    return false;
+  }
+  for (auto i = a.children.begin(), j = b.children.begin();
+       i != a.children.end(); ++i, ++j) {
+    const auto x = *i;
+    const auto y = *j;
+    if (x.type != y.type) {
+      return false;
+    }
+    if (x.type == Parser::Token::Value::TOKEN
+            ? !sameTree(x.getToken(), y.getToken())
+            : !(x.getLiteral() == y.getLiteral())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// nullBuffer discards everything written to it.
+class nullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// countAllocations runs f once and returns the number of allocations it made.
+size_t countAllocations(std::function<void()> f) {
+  const size_t before = allocations.load(std::memory_order_relaxed);
+  f();
+  return allocations.load(std::memory_order_relaxed) - before;
+}
+
+// time runs f the given number of times and returns the number of seconds the
+// fastest run took. If given, before is run before each run of f untimed.
+double time(int runs, std::function<void()> f,
+            std::function<void()> before = nullptr) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    if (before) {
+      before();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+// resetPeakRss resets the peak resident set size of the process, so that
+// peakRss measures each input on its own. Linux supports this since 4.0.
+void resetPeakRss() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+}
+
+// peakRss returns the peak resident set size of the process in bytes.
+size_t peakRss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.starts_with("VmHWM:")) {
+      return std::stoul(line.substr(6)) << 10;
+    }
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<size_t>(usage.ru_maxrss) << 10;
+}
+
+// parseSize parses a number of bytes with an optional K, M or G suffix.
+std::optional<size_t> parseSize(const std::string& arg) {
+  size_t end;
+  size_t size;
+  try {
+    size = std::stoul(arg, &end);
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+  const std::string suffix = arg.substr(end);
+  if (suffix == "K") {
+    return size << 10;
+  } else if (suffix == "M") {
+    return size << 20;
+  } else if (suffix == "G") {
+    return size << 30;
+  } else if (suffix.empty()) {
+    return size;
+  }
+  return std::nullopt;
+}
+
+// number writes a JSON number, which cannot be infinite.
+std::string number(double value) {
+  if (!std::isfinite(value)) {
+    return "null";
+  }
+  std::stringstream ss;
+  ss << std::setprecision(6) << value;
+  return ss.str();
+}
+
+struct stage {
+  std::string name;
+  std::optional<double> seconds;  // none if the stage was skipped
+  size_t tokens;
+};
+
+// allocation is the number of allocations a parser made for a program, and
+// the number of them that the chunks of the tree it built made.
+struct allocation {
+  std::string name;
+  size_t count;
+  size_t chunks;
+};
+
+void report(std::ostream& out, const std::string& name, size_t bytes,
+            size_t lexemes, const Parser::Program* program,
+            const std::vector<allocation>& allocated,
+            const std::vector<stage>& stages, bool last) {
+  out << "    {\n"
+      << "      \"size\": \"" << name << "\",\n"
+      << "      \"bytes\": " << bytes << ",\n"
+      << "      \"lexemes\": " << lexemes << ",\n"
+      << "      \"peakRssBytes\": " << peakRss() << ",\n";
+  if (program != nullptr) {
+    out << "      \"treeNodes\": " << program->tree().size() << ",\n"
+        << "      \"treeBytes\": " << program->tree().bytes() << ",\n";
+  }
+  for (const auto& a : allocated) {
+    out << "      \"" << a.name << "\": " << a.count << ",\n";
+  }
+  out << "      \"stages\": [\n";
+  for (size_t i = 0; i < stages.size(); i++) {
+    const auto& s = stages[i];
+    out << "        {\"name\": \"" << s.name << "\", ";
+    if (s.seconds) {
+      out << "\"seconds\": " << number(*s.seconds) << ", "
+          << "\"mbPerSecond\": " << number(bytes / *s.seconds / 1e6) << ", "
+          << "\"tokensPerSecond\": " << number(s.tokens / *s.seconds) << "}";
+    } else {
+      out << "\"skipped\": true}";
+    }
+    out << (i + 1 < stages.size() ? ",\n" : "\n");
+  }
+  out << "      ]\n"
+      << "    }" << (last ? "\n" : ",\n");
+}
+
+void usage(const char* name) {
+  std::cerr << "usage: " << name
+            << " [--decls w] [--displays w] [--exprs w] [--comments w]"
+               " [--depth n] [--seed n] [--runs n] [--tree-limit size]"
+               " size..."
+            << std::endl
+            << "sizes are in bytes with an optional K, M or G suffix"
+            << std::endl;
+}
+}  // namespace
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+int main(int argc, char* argv[]) {
+  mix m;
+  uint32_t seed = 1;
+  int runs = 3;
+  std::vector<std::string> names;
+
+  // Each parse tree takes up about 30 bytes per byte of source, and the trees
+  // of both parsers are held at once to compare them, so larger inputs are
+  // only lexed.
+  std::optional<size_t> treeLimit = 16 << 20;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (!arg.starts_with("--")) {
+      names.push_back(arg);
+      continue;
+    }
+    if (i + 1 == argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const std::string value = argv[++i];
+    try {
+      if (arg == "--decls") {
+        m.decls = std::stod(value);
+      } else if (arg == "--displays") {
+        m.displays = std::stod(value);
+      } else if (arg == "--exprs") {
+        m.exprs = std::stod(value);
+      } else if (arg == "--comments") {
+        m.comments = std::stod(value);
+      } else if (arg == "--depth") {
+        m.depth = std::stoi(value);
+      } else if (arg == "--seed") {
+        seed = std::stoul(value);
+      } else if (arg == "--runs") {
+        runs = std::stoi(value);
+      } else if (arg == "--tree-limit") {
+        treeLimit = parseSize(value);
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    } catch (const std::logic_error&) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<size_t> sizes;
+  for (const auto& name : names) {
+    const auto size = parseSize(name);
+    if (!size) {
+      usage(argv[0]);
+      return 1;
+    }
+    sizes.push_back(*size);
+  }
+  const bool validMix =
+      std::min({m.decls, m.displays, m.exprs, m.comments}) >= 0 &&
+      m.displays + m.exprs > 0;
+  if (sizes.empty() || !treeLimit || runs < 1 || !validMix) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The grammar is loaded before anything is lexed, since lexemes are tagged
+  // with its symbols.
+  std::optional<Grammar> grammar;
+  const double grammarTime =
+      time(runs, [&]() { grammar.emplace("grammar.txt"); });
+  Parser parser(*grammar);
+  DescentParser descent(parser);
+
+  std::cout << "{\n"
+            << "  \"grammarSeconds\": " << number(grammarTime) << ",\n"
+            << "  \"inputs\": [\n";
+
+  // first is the first program with a tree, and fixed holds how many of the
+  // allocations of each of its parses were not chunks of its tree.
+  std::string first;
+  std::vector<size_t> fixed;
+  bool failed = false;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    resetPeakRss();
+    generator gen(m, seed);
+    const std::string program = gen.generate(sizes[i]);
+    const auto source = Lexer::Source::borrow(program);
+
+    Lexer::Lines lines;
+    const double lexTime = time(
+        runs, [&]() { lines = Lexer::lex(source); },
+        [&]() { lines = Lexer::Lines(); });
+    const size_t lexemes = lines.flatten().size();
+
+    Lexer::Lines file;
+    const double commentsTime =
+        time(runs, [&]() { file = lines.removeComments(); });
+    const size_t tokens = file.flatten().size();
+
+    std::optional<double> parseTime;
+    std::optional<double> validateTime;
+    std::optional<double> descentTime;
+    std::optional<double> printTime;
+    std::optional<double> transpileTime;
+    std::optional<Parser::Program> parsed;
+    std::vector<allocation> allocated;
+    if (program.size() <= *treeLimit) {
+      std::optional<Parser::Program> descended;
+      descentTime = time(
+          runs, [&]() { descended.emplace(descent.parse(file)); },
+          [&]() { descended.reset(); });
+
+      parseTime = time(
+          runs, [&]() { parsed.emplace(parser.parse(file)); },
+          [&]() { parsed.reset(); });
+      if (!sameTree(*parsed, *descended)) {
+        std::cerr << "error: the parsers built different trees for "
+                  << names[i] << std::endl;
+        return 1;
+      }
+
+      // Building a tree allocates its chunks of nodes and literals, and
+      // validating a program builds no tree.
+      allocated.push_back({"parseAllocations", countAllocations([&]() {
+                             parsed.reset();
+                             parsed.emplace(parser.parse(file));
+                           }),
+                           parsed->tree().allocations()});
+      allocated.push_back({"descentAllocations", countAllocations([&]() {
+                             descended.reset();
+                             descended.emplace(descent.parse(file));
+                           }),
+                           descended->tree().allocations()});
+      Parser::ParseListener validator;
+      validateTime = time(runs, [&]() { parser.parse(file, validator); });
+      allocated.push_back({"validateAllocations", countAllocations([&]() {
+                             parser.parse(file, validator);
+                           }),
+                           0});
+
+      printTime = time(runs, [&]() {
+        nullBuffer discard;
+        std::ostream out(&discard);
+        out << *parsed;
+      });
+      transpileTime = time(runs, [&]() {
+        nullBuffer discard;
+        std::ostream out(&discard);
+        CTranspiler::transpile(out, *parsed);
+      });
+    }
+
+    report(std::cout, names[i], program.size(), lexemes,
+           parsed ? &*parsed : nullptr, allocated,
+           {
+               {"lex", lexTime, lexemes},
+               {"removeComments", commentsTime, lexemes},
+               {"parse", parseTime, tokens},
+               {"validate", validateTime, tokens},
+               {"descentParse", descentTime, tokens},
+               {"print", printTime, tokens},
+               {"transpile", transpileTime, tokens},
+           },
+           i + 1 == sizes.size());
+
+    // Parses allocate nothing per lexeme besides the chunks of their trees,
+    // so parsing any two programs differs by exactly the allocations of
+    // their chunks.
+    if (fixed.empty()) {
+      first = names[i];
+      for (const auto& a : allocated) {
+        fixed.push_back(a.count - a.chunks);
+      }
+    }
+    for (size_t a = 0; a < allocated.size(); a++) {
+      const auto& got = allocated[a];
+      if (got.count - got.chunks != fixed[a]) {
+        std::cerr << "error: " << got.name << " is " << got.count << " for "
+                  << names[i] << ", of which " << got.chunks
+                  << " are chunks of its tree, but " << fixed[a]
+                  << " besides the chunks for " << first << std::endl;
+        failed = true;
+      }
+    }
+  }
+
+  std::cout << "  ]\n"
+            << "}" << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+// grammar benchmarks loading generated grammars of the given numbers of
+// productions and prints the results as JSON. Loading a grammar computes its
+// members of first and follow; building its predictive parsing table and
+// compiling it for the parser are timed separately.
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../lib/grammar.hpp"
+
+namespace {
+// generateGrammar generates a grammar of about the given number of productions
+// with about three productions per non-terminal. Non-terminals only start the
+// right sides of non-terminals before them, so the grammar is not left
+// recursive, and each one is on the right side of the one before it, so every
+// non-terminal is reachable. About a third of them are nullable, which makes
+// members of follow flow down long chains.
+std::string generateGrammar(size_t productions, uint32_t seed) {
+  std::mt19937 rng(seed);
+  const size_t count = std::max<size_t>(productions / 3, 1);
+  const auto nonTerminal = [](size_t i) {
+    return "<n" + std::to_string(i) + ">";
+  };
+  const auto terminal = [&]() { return "t" + std::to_string(rng() % 64); };
+  // later returns a non-terminal after i, or a terminal if there is none.
+  const auto later = [&](size_t i) {
+    if (i + 1 == count) {
+      return terminal();
+    }
+    return nonTerminal(i + 1 + rng() % (count - i - 1));
+  };
+  const auto any = [&]() { return nonTerminal(rng() % count); };
+
+  std::string out;
+  size_t written = 0;
+  for (size_t i = 0; i < count; i++) {
+    const std::string left = nonTerminal(i) + " -> ";
+    out += left + terminal() + " " + later(i) + " " + any() + "\n";
+    out += left + later(i) + " " + terminal() + "\n";
+    written += 2;
+    if (written < productions) {
+      out += left + (rng() % 3 == 0 ? "λ" : terminal() + " " + any()) + "\n";
+      written++;
+    }
+  }
+  return out;
+}
+
+// time runs f the given number of times and returns the number of seconds the
+// fastest run took.
+double time(int runs, std::function<void()> f) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+void usage(const char* name) {
+  std::cerr << "usage: " << name << " [--seed n] [--runs n] productions..."
+            << std::endl;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t seed = 1;
+  int runs = 3;
+  std::vector<size_t> sizes;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if (!arg.starts_with("--")) {
+        sizes.push_back(std::stoul(arg));
+      } else if (i + 1 == argc) {
+        usage(argv[0]);
+        return 1;
+      } else if (arg == "--seed") {
+        seed = std::stoul(argv[++i]);
+      } else if (arg == "--runs") {
+        runs = std::stoi(argv[++i]);
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+  } catch (const std::logic_error&) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (sizes.empty() || runs < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::cout << "{\n"
+            << "  \"grammars\": [\n";
+  for (size_t i = 0; i < sizes.size(); i++) {
+    const std::string text = generateGrammar(sizes[i], seed);
+
+    std::optional<Grammar> grammar;
+    const double loadTime = time(runs, [&]() {
+      std::istringstream in(text);
+      grammar.emplace(in);
+    });
+    const double tableTime = time(
+        runs, [&]() { grammar->constructPredictiveParsingTable(); });
+    const double compileTime =
+        time(runs, [&]() { grammar->compileParsingTable(); });
+    const size_t denseCells =
+        grammar->compileParsingTable(Grammar::DENSE).size();
+    const size_t combCells = grammar->compileParsingTable(Grammar::COMB).size();
+
+    std::cout << "    {\"productions\": " << sizes[i] << ", "
+              << "\"nonTerminals\": " << grammar->getNonTerminals().size()
+              << ", "
+              << "\"loadSeconds\": " << loadTime << ", "
+              << "\"tableSeconds\": " << tableTime << ", "
+              << "\"compileSeconds\": " << compileTime << ", "
+              << "\"denseCells\": " << denseCells << ", "
+              << "\"combCells\": " << combCells << "}"
+              << (i + 1 < sizes.size() ? ",\n" : "\n");
+  }
+  std::cout << "  ]\n"
+            << "}" << std::endl;
+}
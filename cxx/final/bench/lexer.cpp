@@ -0,0 +1,132 @@
+// lexer benchmarks the stream and buffer backends of Lexer::lex and
+// Lexer::lexParallel against each other on the given program, repeated until
+// the input is large enough.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../lib/lexer.hpp"
+#include "../lib/scan.hpp"
+
+namespace {
+// time runs f a few times and returns the number of seconds the fastest run
+// took.
+double time(std::function<void()> f) {
+  double best = 0;
+  for (int i = 0; i < 3; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+bool sameLines(const Lexer::Lines& a, const Lexer::Lines& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    const auto lineA = a[i];
+    const auto lineB = b[i];
+    if (!(lineA.loc == lineB.loc) || lineA.size() != lineB.size() ||
+        !std::equal(lineA.begin(), lineA.end(), lineB.begin())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void report(const std::string& name, double seconds, size_t bytes) {
+  std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+            << std::setprecision(3) << std::setw(10) << seconds * 1000
+            << " ms" << std::setprecision(1) << std::setw(10)
+            << bytes / seconds / 1e6 << " MB/s" << std::setprecision(2)
+            << std::setw(8) << seconds * 1e9 / bytes << " ns/byte"
+            << std::endl;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "usage: " << argv[0] << " program_file [megabytes]"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream in(argv[1]);
+  if (!in) {
+    std::cerr << "error: could not open file " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::stringstream program;
+  program << in.rdbuf();
+
+  const size_t size = (argc == 3 ? std::stoul(argv[2]) : 8) << 20;
+  std::string input;
+  input.reserve(size + program.str().size());
+  while (input.size() < size) {
+    input += program.str();
+    input += "\n";
+  }
+
+  Lexer::Lines streamed;
+  const double streamTime = time([&]() {
+    std::istringstream stream(input);
+    streamed = Lexer::lex(stream);
+  });
+
+  std::cout << "input: " << input.size() << " bytes, " << streamed.size()
+            << " lines" << std::endl;
+  report("stream", streamTime, input.size());
+
+  // The buffer backend is run once per scanning kernel this CPU supports.
+  double bestTime = 0;
+  for (const auto kernels : Scan::available()) {
+    Scan::use(kernels);
+
+    Lexer::Lines buffered;
+    const double bufferTime =
+        time([&]() { buffered = Lexer::lex(Lexer::Source::borrow(input)); });
+
+    if (!sameLines(streamed, buffered)) {
+      std::cerr << "error: stream and buffer backends disagree" << std::endl;
+      return 1;
+    }
+
+    report("buffer/" + std::string(kernels), bufferTime, input.size());
+    if (bestTime == 0 || bufferTime < bestTime) {
+      bestTime = bufferTime;
+    }
+  }
+
+  // The parallel lexer runs with the fastest kernels.
+  Scan::use(Scan::available().front());
+  const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+  Lexer::Lines parallel;
+  const double parallelTime = time([&]() {
+    parallel = Lexer::lexParallel(Lexer::Source::borrow(input), threads);
+  });
+
+  if (!sameLines(streamed, parallel)) {
+    std::cerr << "error: stream and parallel lexers disagree" << std::endl;
+    return 1;
+  }
+
+  report("parallel/" + std::to_string(threads), parallelTime, input.size());
+
+  std::cout << "speedup: " << std::setprecision(2) << streamTime / bestTime
+            << "x, parallel " << streamTime / parallelTime << "x" << std::endl;
+}
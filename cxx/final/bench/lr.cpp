@@ -0,0 +1,133 @@
+// lr benchmarks LRParser on generated expressions of the given numbers of
+// tokens and prints the results as JSON. The table must be one of an
+// expression grammar over i, +, -, *, /, ( and ), like the one handout-08
+// comes with or the one tools/generate-lr.cpp writes from its grammar.txt.
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../lib/lr.hpp"
+
+namespace {
+// generateExpression generates an expression of about the given number of
+// tokens, ending with $. Operands are nested in parentheses now and then, but
+// never more than a few levels deep.
+std::string generateExpression(size_t tokens, uint32_t seed) {
+  std::mt19937 rng(seed);
+  static const char operators[] = "+-*/";
+  std::string out;
+  out.reserve(tokens + 16);
+  size_t depth = 0;
+  for (;;) {
+    while (depth < 4 && rng() % 4 == 0) {
+      out += '(';
+      depth++;
+    }
+    out += 'i';
+    while (depth > 0 && rng() % 3 == 0) {
+      out += ')';
+      depth--;
+    }
+    if (out.size() + depth >= tokens) {
+      break;
+    }
+    out += operators[rng() % 4];
+  }
+  out.append(depth, ')');
+  return out + '$';
+}
+
+// time runs f the given number of times and returns the number of seconds the
+// fastest run took.
+double time(int runs, std::function<void()> f) {
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+void usage(const char* name) {
+  std::cerr << "usage: " << name
+            << " [--seed n] [--runs n] table_file rules_file tokens..."
+            << std::endl;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t seed = 1;
+  int runs = 3;
+  std::vector<std::string> files;
+  std::vector<size_t> sizes;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if (!arg.starts_with("--")) {
+        if (files.size() < 2) {
+          files.push_back(arg);
+        } else {
+          sizes.push_back(std::stoul(arg));
+        }
+      } else if (i + 1 == argc) {
+        usage(argv[0]);
+        return 1;
+      } else if (arg == "--seed") {
+        seed = std::stoul(argv[++i]);
+      } else if (arg == "--runs") {
+        runs = std::stoi(argv[++i]);
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+  } catch (const std::logic_error&) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (sizes.empty() || runs < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  LRParser parser(files[0], files[1]);
+  std::cout << "{\n"
+            << "  \"states\": " << parser.states() << ",\n"
+            << "  \"expressions\": [\n";
+  bool ok = true;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    const std::string expression = generateExpression(sizes[i], seed);
+    // The expression is parsed up to its last token, so a closing
+    // parenthesis before the end makes it fail as late as possible.
+    const std::string invalid =
+        expression.substr(0, expression.size() - 1) + ")$";
+
+    bool accepted = false;
+    const double seconds =
+        time(runs, [&]() { accepted = parser.parse(expression); });
+    const bool rejected = !parser.parse(invalid);
+    ok &= accepted && rejected;
+
+    const size_t tokens = expression.size();
+    std::cout << "    {\"tokens\": " << tokens << ", "
+              << "\"seconds\": " << seconds << ", "
+              << "\"tokensPerSecond\": " << tokens / seconds << ", "
+              << "\"accepted\": " << (accepted ? "true" : "false") << ", "
+              << "\"rejected\": " << (rejected ? "true" : "false") << "}"
+              << (i + 1 < sizes.size() ? ",\n" : "\n");
+  }
+  std::cout << "  ]\n"
+            << "}" << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Bitset is a set of small integers stored as a bit per integer. Unlike
+// std::bitset, its size is set at runtime.
+class Bitset {
+ public:
+  Bitset() = default;
+  explicit Bitset(size_t size) : words((size + 63) / 64) {}
+
+  bool test(size_t i) const { return words[i / 64] >> (i % 64) & 1; }
+
+  // set adds i and returns true if it was not in the set yet.
+  bool set(size_t i) {
+    const uint64_t bit = uint64_t(1) << (i % 64);
+    const bool added = !(words[i / 64] & bit);
+    words[i / 64] |= bit;
+    return added;
+  }
+
+  // merge adds every integer in other, which must be the same size, and
+  // returns true if any of them was not in the set yet.
+  bool merge(const Bitset& other) {
+    uint64_t added = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+      added |= other.words[w] & ~words[w];
+      words[w] |= other.words[w];
+    }
+    return added != 0;
+  }
+
+  bool empty() const {
+    for (const auto word : words) {
+      if (word != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void clear() {
+    for (auto& word : words) {
+      word = 0;
+    }
+  }
+
+  // forEach calls f with every integer in the set in increasing order.
+  template <class F>
+  void forEach(F f) const {
+    for (size_t w = 0; w < words.size(); w++) {
+      for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+        f(w * 64 + __builtin_ctzll(word));
+      }
+    }
+  }
+
+  bool operator==(const Bitset& other) const { return words == other.words; }
+
+  // data returns the words that the integers are stored in, 64 to a word with
+  // the lowest integers in the lowest bits.
+  std::span<const uint64_t> data() const { return words; }
+  std::span<uint64_t> data() { return words; }
+
+ private:
+  std::vector<uint64_t> words;
+};
@@ -1,5 +1,6 @@
 #include "error.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 std::string formatLine(const Lexer::Lines& lines, Lexer::Lexeme lexeme) {
@@ -12,6 +13,37 @@ std::string formatLine(const Lexer::Lines& lines, Lexer::Location loc) {
     return "";
   }
 
+  // Point into the source text itself when there is one, so that the columns
+  // are the real ones.
+  const auto columns = lines.relativeLocation(loc);
+  if (columns.start != -1) {
+    const auto text = lines.source()->text();
+    const size_t start = loc.start - columns.start;
+    size_t end = text.find('\n', loc.start);
+    if (end == std::string_view::npos) {
+      end = text.size();
+    }
+    if (end > start && text[end - 1] == '\r') {
+      end--;
+    }
+
+    // Keep tabs in the indentation of the carets so they line up.
+    std::string indent(text.substr(start, columns.start));
+    for (auto& c : indent) {
+      if (c != '\t') {
+        c = ' ';
+      }
+    }
+    const int64_t carets = std::max<int64_t>(
+        std::min<int64_t>(loc.end, end) - loc.start, 1);
+
+    std::stringstream ss;
+    ss << "\n"
+       << "    | " << text.substr(start, end - start) << "\n"
+       << "    | " << indent << std::string(carets, '^');
+    return ss.str();
+  }
+
   const auto& line = lines[linenum];
   const auto lineLocation = line.relativeLocation(loc);
 
@@ -1,15 +1,309 @@
 #include "grammar.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <optional>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "lexer.hpp"
+#include "symbols.hpp"
+
+namespace {
+// CACHE_VERSION must change whenever what is written to grammar cache files
+// changes, so that older files are not read. The payload of a cache file is
+// the Grammar::Tables of the grammar.
+constexpr char CACHE_MAGIC[8] = {'G', 'R', 'M', 'C', 'A', 'C', 'H', 'E'};
+constexpr uint32_t CACHE_VERSION = 4;
+constexpr uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+// cacheHeader starts every grammar cache file. The payload follows it.
+struct cacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;  // numbers are stored in the byte order of the writer
+  uint64_t key;        // hash of the grammar text
+  uint64_t size;       // size of the payload
+  uint64_t checksum;   // hash of the payload
+};
+
+// hash returns a 64-bit FNV-1a hash of the given bytes, taken 8 bytes at a
+// time instead of 1 to make it several times faster.
+uint64_t hash(std::string_view bytes) {
+  uint64_t h = 14695981039346656037u;
+  for (; bytes.size() >= 8; bytes.remove_prefix(8)) {
+    uint64_t word;
+    std::memcpy(&word, bytes.data(), 8);
+    h = (h ^ word) * 1099511628211u;
+  }
+  for (const unsigned char c : bytes) {
+    h = (h ^ c) * 1099511628211u;
+  }
+  return h;
+}
+
+// cacheWriter writes the payload of a grammar cache file. Every value is
+// padded to a multiple of 4 bytes.
+struct cacheWriter {
+  std::string bytes;
+
+  void number(uint32_t value) { write(&value, sizeof(value)); }
+
+  void strings(std::span<const std::string_view> values) {
+    number(values.size());
+    for (const auto value : values) {
+      number(value.size());
+      write(value.data(), value.size());
+    }
+  }
+
+  template <class T>
+  void array(std::span<const T> values) {
+    number(values.size());
+    write(values.data(), values.size_bytes());
+  }
+
+ private:
+  void write(const void* data, size_t size) {
+    bytes.append(static_cast<const char*>(data), size);
+    bytes.resize((bytes.size() + 3) / 4 * 4, '\0');
+  }
+};
+
+// cacheReader reads back what a cacheWriter wrote. It throws if the payload
+// ends early.
+struct cacheReader {
+  std::string_view bytes;
+
+  uint32_t number() {
+    uint32_t value;
+    read(&value, sizeof(value));
+    return value;
+  }
+
+  // strings returns views of the strings in the payload.
+  std::vector<std::string_view> strings() {
+    std::vector<std::string_view> values(count(4));
+    for (auto& value : values) {
+      const size_t size = number();
+      value = bytes.substr(0, size);
+      read(nullptr, size);
+    }
+    return values;
+  }
+
+  template <class T>
+  std::vector<T> array() {
+    std::vector<T> values(count(sizeof(T)));
+    read(values.data(), values.size() * sizeof(T));
+    return values;
+  }
+
+ private:
+  // count reads the number of values that follow, which are at least the
+  // given size each, so that nothing too large for the payload is allocated.
+  size_t count(size_t size) {
+    const size_t values = number();
+    if (values * size > bytes.size()) {
+      throw std::out_of_range("grammar cache ends early");
+    }
+    return values;
+  }
+
+  void read(void* data, size_t size) {
+    const size_t padded = (size + 3) / 4 * 4;
+    if (padded > bytes.size()) {
+      throw std::out_of_range("grammar cache ends early");
+    }
+    if (data != nullptr) {
+      std::memcpy(data, bytes.data(), size);
+    }
+    bytes.remove_prefix(padded);
+  }
+};
+
+// mappedFile is a file mapped into memory, which is unmapped when it is
+// destroyed. It is empty if the file cannot be mapped.
+class mappedFile {
+ public:
+  mappedFile(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* mapped =
+          ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data = static_cast<const char*>(mapped);
+        size = st.st_size;
+      }
+    }
+    ::close(fd);
+  }
+
+  mappedFile(const mappedFile&) = delete;
+  mappedFile& operator=(const mappedFile&) = delete;
+
+  ~mappedFile() {
+    if (data != nullptr) {
+      ::munmap(const_cast<char*>(data), size);
+    }
+  }
+
+  std::string_view bytes() const { return {data, size}; }
+
+ private:
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// ebnfReader reads the right side of a grammar line, in which { α | β }
+// derives any of its alternatives any number of times, [ α | β ] derives any
+// of them or nothing, and <x>* is { <x> }. Each of these groups is replaced by
+// a new non-terminal: a repetition G by G -> α G, G -> β G and G -> λ, and an
+// option by G -> α, G -> β and G -> λ.
+class ebnfReader {
+ public:
+  // The right side of the line, and the grammar entries of the groups in it
+  // in the order the groups open.
+  std::vector<std::string> right;
+  std::vector<Grammar::GrammarEntry> entries;
+
+  // name returns the name of a new group.
+  template <class Name>
+  ebnfReader(const std::string& line, const std::vector<std::string>& tokens,
+             Name name)
+      : line(line), tokens(tokens), name(name) {
+    right = read("").front();
+    for (auto& group : groups) {
+      std::move(group.begin(), group.end(), std::back_inserter(entries));
+    }
+  }
+
+ private:
+  const std::string& line;
+  const std::vector<std::string>& tokens;
+  std::function<std::string()> name;
+  size_t i = 2;  // after the left side and ->
+  std::vector<std::vector<Grammar::GrammarEntry>> groups;
+
+  // read reads alternatives separated by | up to the given closing token, or
+  // to the end of the line, where there is only one.
+  std::vector<std::vector<std::string>> read(std::string_view closer) {
+    std::vector<std::vector<std::string>> alternatives(1);
+    for (; i < tokens.size(); i++) {
+      const auto& token = tokens[i];
+      if (!closer.empty() && token == closer) {
+        return alternatives;
+      }
+
+      if (token == "{" || token == "[") {
+        const size_t g = groups.size();
+        const std::string group = open();
+        i++;
+        close(g, group, read(token == "{" ? "}" : "]"), token == "{");
+        alternatives.back().push_back(group);
+      } else if (token.size() > 1 && token.back() == '*' &&
+                 Grammar::isNonTerminal(token.substr(0, token.size() - 1))) {
+        const size_t g = groups.size();
+        const std::string group = open();
+        close(g, group, {{token.substr(0, token.size() - 1)}}, true);
+        alternatives.back().push_back(group);
+      } else if (token == "|") {
+        alternatives.emplace_back();
+      } else if (token == "}" || token == "]") {
+        throw std::invalid_argument(line);
+      } else {
+        alternatives.back().push_back(token);
+      }
+    }
+    if (!closer.empty() || alternatives.size() > 1) {
+      throw std::invalid_argument(line);
+    }
+    return alternatives;
+  }
+
+  std::string open() {
+    groups.emplace_back();
+    return name();
+  }
+
+  // close adds the grammar entries of a group.
+  void close(size_t g, const std::string& group,
+             std::vector<std::vector<std::string>> alternatives,
+             bool repeats) {
+    for (auto& right : alternatives) {
+      if (right.empty()) {
+        continue;
+      }
+      if (repeats) {
+        right.push_back(group);
+      }
+      groups[g].emplace_back(group, std::move(right));
+    }
+    groups[g].emplace_back(group, std::vector<std::string>{LAMBDA});
+  }
+};
+
+// nfa is a nondeterministic finite automaton over bytes with λ moves, which
+// lexical rules are built as before they are turned into DFAs.
+struct nfa {
+  // MAX_STATES is how many states an NFA may have, since the same
+  // non-terminal is expanded again wherever a different string follows it.
+  static constexpr size_t MAX_STATES = 1 << 14;
+
+  struct state {
+    std::vector<std::pair<unsigned char, uint32_t>> moves;
+    std::vector<uint32_t> lambdas;
+  };
+  std::vector<state> states;
+
+  uint32_t add() {
+    states.emplace_back();
+    return states.size() - 1;
+  }
+
+  // close adds every state that λ moves lead to from the given states, and
+  // sorts them.
+  void close(std::vector<uint32_t>& set) const {
+    std::vector<bool> in(states.size());
+    for (const auto s : set) {
+      in[s] = true;
+    }
+    for (size_t i = 0; i < set.size(); i++) {
+      for (const auto to : states[set[i]].lambdas) {
+        if (!in[to]) {
+          in[to] = true;
+          set.push_back(to);
+        }
+      }
+    }
+    std::sort(set.begin(), set.end());
+  }
+};
+}  // namespace
+
 Grammar::Grammar(std::istream& grammarFile) {
   prepareGrammar(grammarFile);
   process();
@@ -21,9 +315,36 @@ Grammar::Grammar(std::string grammarPath) {
   process();
 }
 
+Grammar::Grammar(std::string grammarPath, std::string cachePath) {
+  const mappedFile grammarFile(grammarPath);
+  const uint64_t key = hash(grammarFile.bytes());
+  if (loadCache(cachePath, key)) {
+    return;
+  }
+
+  std::istringstream text{std::string(grammarFile.bytes())};
+  prepareGrammar(text);
+  process();
+  saveCache(cachePath, key);
+}
+
 void Grammar::process() {
+  // Intern every symbol up front, so that lexemes lexed from now on carry
+  // their symbols.
+  for (const auto& symbol : {std::string("$"), LAMBDA, SIGMA}) {
+    Symbols::intern(symbol);
+  }
+  for (const auto& [nonTerminal, rightSide] : grammar) {
+    Symbols::intern(nonTerminal);
+    for (const auto& token : rightSide) {
+      Symbols::intern(token);
+    }
+  }
+
+  numberSymbols();
   findMembersOfFirst();
   findMembersOfFollow();
+  findLexicalRules();
 }
 
 void Grammar::printGrammar() const {
@@ -43,35 +364,49 @@ void Grammar::printMembersOfFirst() const {
 
   // Prints first members in order of non-terminal declarations in the original
   // grammar file.
-  for (const auto& nonTerminal : nonTerminalSetOrder) {
-    if (firstMembers.find(nonTerminal) == firstMembers.end()) {
-      std::cerr << nonTerminal << ": {}" << std::endl;
+  for (size_t n = 0; n < nonTerminalSetOrder.size(); n++) {
+    if (firstMembers[n].empty() && !nullable.test(n)) {
+      std::cerr << nonTerminalSetOrder[n] << ": {}" << std::endl;
       continue;
     }
 
-    std::cerr << nonTerminal << ": { ";
-    for (const auto& terminal : firstMembers.at(nonTerminal)) {
-      std::cerr << terminal << ' ';
+    // Terminals are numbered in sorted order, so λ is printed where it sorts.
+    std::cerr << nonTerminalSetOrder[n] << ": { ";
+    for (size_t t = 0; t < terminalNames.size(); t++) {
+      if (firstMembers[n].test(t) || (t == lambda && nullable.test(n))) {
+        std::cerr << terminalNames[t] << ' ';
+      }
     }
     std::cerr << "}" << std::endl;
   }
 }
 
+std::vector<std::string> Grammar::getMembersOfFollow(
+    const std::string& nonTerminal) const {
+  std::vector<std::string> members;
+  const auto it = std::find(nonTerminalSetOrder.begin(),
+                            nonTerminalSetOrder.end(), nonTerminal);
+  if (it != nonTerminalSetOrder.end()) {
+    followMembers[it - nonTerminalSetOrder.begin()].forEach(
+        [&](size_t t) { members.push_back(terminalNames[t]); });
+  }
+  return members;
+}
+
 void Grammar::printMembersOfFollow() const {
   std::cerr << "====== Members of Follow ======" << std::endl;
 
   // Prints follow members in order of non-terminal declarations in the original
   // grammar file.
-  for (const auto& nonTerminal : nonTerminalSetOrder) {
-    if (followMembers.find(nonTerminal) == followMembers.end()) {
-      std::cerr << nonTerminal << ": {}" << std::endl;
+  for (size_t n = 0; n < nonTerminalSetOrder.size(); n++) {
+    if (followMembers[n].empty()) {
+      std::cerr << nonTerminalSetOrder[n] << ": {}" << std::endl;
       continue;
     }
 
-    std::cerr << nonTerminal << ": { ";
-    for (const auto& terminal : followMembers.at(nonTerminal)) {
-      std::cerr << terminal << ' ';
-    }
+    std::cerr << nonTerminalSetOrder[n] << ": { ";
+    followMembers[n].forEach(
+        [&](size_t t) { std::cerr << terminalNames[t] << ' '; });
     std::cerr << "}" << std::endl;
   }
 }
@@ -100,221 +435,493 @@ void Grammar::printPredictiveParsingTable() const {
 
 Grammar::ParsingTable Grammar::constructPredictiveParsingTable() const {
   ParsingTable table;
-
-  // Constructs the predictive parsing table
   for (const auto& nonTerminal : nonTerminalSetOrder) {
-    for (const auto& pair : grammar) {
-      if (pair.first != nonTerminal) {
-        continue;
+    table[nonTerminal];
+  }
+
+  forEachTableCell([&](size_t n, size_t t, size_t p) {
+    table[nonTerminalSetOrder[n]][terminalNames[t]] = grammar[p].second;
+  });
+  return table;
+}
+
+Grammar::CompiledTable Grammar::compileParsingTable(TableLayout layout) const {
+  if (layout == AUTO && cachedTable) {
+    return *cachedTable;
+  }
+  if (grammar.size() >= CompiledTable::ERROR) {
+    throw std::length_error("too many grammar entries to compile");
+  }
+
+  CompiledTable table = indexParsingTable();
+  const size_t rows = nonTerminalSetOrder.size();
+  const size_t columns = terminalNames.size();
+
+  std::vector<CompiledTable::Production> dense(rows * columns,
+                                               CompiledTable::ERROR);
+  forEachTableCell(
+      [&](size_t n, size_t t, size_t p) { dense[n * columns + t] = p; });
+
+  if (layout == AUTO) {
+    layout = rows * columns > COMB_CELLS ? COMB : DENSE;
+  }
+  table.offsets.resize(rows);
+  if (layout == DENSE) {
+    for (size_t n = 0; n < rows; n++) {
+      table.offsets[n] = n * columns;
+    }
+    table.cells = std::move(dense);
+    return table;
+  }
+
+  // Places the rows with the most cells first, each at the first offset found
+  // where none of its cells lands on a cell that was already placed.
+  std::vector<std::vector<size_t>> filled(rows);
+  std::vector<size_t> order(rows);
+  for (size_t n = 0; n < rows; n++) {
+    order[n] = n;
+    for (size_t t = 0; t < columns; t++) {
+      if (dense[n * columns + t] != CompiledTable::ERROR) {
+        filled[n].push_back(t);
       }
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return filled[a].size() > filled[b].size();
+  });
 
-      if (pair.second.size() == 1 && pair.second.at(0) == LAMBDA) {
-        // All y in Follow(A)
-        for (const auto& terminal : followMembers.at(pair.first)) {
-          table[pair.first][terminal] = {LAMBDA};
-        }
-      } else if (pair.second.size() == 1 && !isNonTerminal(pair.second.at(0))) {
-        // alpha is terminal
-        table[pair.first][pair.second.at(0)] = {pair.second.at(0)};
-      } else {
-        // if x is in First(B)
-        for (const auto& terminal : getFirstFromRightSide(pair.second)) {
-          if (terminal == LAMBDA) {
-            continue;
-          }
-          table[pair.first][terminal] = pair.second;
-        }
+  // next links every placed cell towards the first free cell after it, so
+  // that runs of placed cells are skipped over.
+  std::vector<size_t> next;
+  const auto nextFree = [&](size_t cell) {
+    size_t free = cell;
+    while (free < next.size() && next[free] != free) {
+      free = next[free];
+    }
+    while (cell != free) {
+      cell = std::exchange(next[cell], free);
+    }
+    return free;
+  };
+  const auto isFree = [&](size_t cell) {
+    return cell >= table.checks.size() ||
+           table.checks[cell] == CompiledTable::NONE;
+  };
+
+  for (const auto n : order) {
+    const auto& row = filled[n];
+    if (row.empty()) {
+      break;
+    }
+
+    // Tries the offsets that put the first cell of the row on a free cell.
+    // Rows that do not fit in the first few are appended instead, which keeps
+    // placing many dense rows from taking quadratic time.
+    size_t offset = std::max(table.checks.size(), row.front()) - row.front();
+    size_t cell = nextFree(row.front());
+    for (size_t tries = 0; tries < 16 * columns && cell < table.checks.size();
+         tries++, cell = nextFree(cell + 1)) {
+      if (std::all_of(row.begin() + 1, row.end(), [&](size_t t) {
+            return isFree(cell - row.front() + t);
+          })) {
+        offset = cell - row.front();
+        break;
       }
     }
+
+    table.offsets[n] = offset;
+    const size_t end = offset + row.back() + 1;
+    if (end > table.cells.size()) {
+      table.cells.resize(end, CompiledTable::ERROR);
+      table.checks.resize(end, CompiledTable::NONE);
+    }
+    while (next.size() < end) {
+      next.push_back(next.size());
+    }
+    for (const auto t : row) {
+      table.cells[offset + t] = dense[n * columns + t];
+      table.checks[offset + t] = n;
+      next[offset + t] = offset + t + 1;
+    }
   }
   return table;
 }
 
-void Grammar::findMembersOfFirst() {
-  for (const auto& nonTerminal : nonTerminalsSet) {
-    findFirstHelper(nonTerminal);
-  }
-}
+Grammar::CompiledTable Grammar::indexParsingTable() const {
+  CompiledTable table;
 
-void Grammar::findFirstHelper(const std::string& nonTerminal) {
-  if (!isNonTerminal(nonTerminal)) {
-    return;
+  // The grammar interned all of its symbols, so they can be found.
+  table.rowOf.assign(Symbols::size(), CompiledTable::NONE);
+  table.columnOf.assign(Symbols::size(), CompiledTable::NONE);
+  for (size_t n = 0; n < nonTerminalSetOrder.size(); n++) {
+    table.rowOf[Symbols::find(nonTerminalSetOrder[n])] = n;
+  }
+  for (size_t t = 0; t < terminalNames.size(); t++) {
+    table.columnOf[Symbols::find(terminalNames[t])] = t;
   }
 
-  // Searches through all rules of the grammar
-  for (const auto& pair : grammar) {
-    if (pair.first != nonTerminal) {
-      continue;
+  for (const auto& entry : grammar) {
+    table.starts.push_back(table.symbols.size());
+    for (const auto& token : entry.second) {
+      if (token != LAMBDA) {
+        table.symbols.push_back(Symbols::find(token));
+      }
     }
+  }
+  table.starts.push_back(table.symbols.size());
+  return table;
+}
 
-    if (!isNonTerminal(pair.second.at(0))) {
-      firstMembers[nonTerminal].insert(pair.second.at(0));
-      continue;
-    }
+template <class F>
+void Grammar::forEachTableCell(F f) const {
+  Bitset first(terminalNames.size());
 
-    bool lastLambda = false;
-    for (const auto& token : pair.second) {
-      if (isNonTerminal(token)) {
-        findFirstHelper(token);
-
-        // Adds all first members from the non-terminal.
-        for (const auto& terminal : firstMembers.at(token)) {
-          if (terminal == LAMBDA) {
-            continue;
-          }
-          firstMembers[nonTerminal].insert(terminal);
-        }
+  // Constructs the predictive parsing table
+  for (size_t n = 0; n < nonTerminalSetOrder.size(); n++) {
+    for (const auto p : productionsOf[n]) {
+      const auto& right = grammar[p].second;
 
-        // If the non-terminal contains no LAMBDA, no need to recursive further
-        if (firstMembers.at(token).find(LAMBDA) ==
-            firstMembers.at(token).end()) {
-          lastLambda = false;
-          break;
-        } else {
-          lastLambda = true;
-        }
+      if (right.size() == 1 && right.at(0) == LAMBDA) {
+        // All y in Follow(A)
+        followMembers[n].forEach([&](size_t t) { f(n, t, p); });
+      } else if (right.size() == 1 && !isNonTerminal(right.at(0))) {
+        // alpha is terminal
+        f(n, productions[p].right.at(0).index, p);
       } else {
-        // If encounter a terminal, add it to the member of first.
-        firstMembers[nonTerminal].insert(token);
-        lastLambda = false;
-        break;
+        // if x is in First(B)
+        first.clear();
+        getFirstFromRightSide(productions[p].right, first);
+        first.forEach([&](size_t t) { f(n, t, p); });
       }
     }
+  }
+}
+
+void Grammar::numberSymbols() {
+  std::set<std::string> terminals = terminalsSet;
+  terminals.insert("$");
+  terminals.insert(LAMBDA);
+  terminalNames.assign(terminals.begin(), terminals.end());
+
+  std::unordered_map<std::string, size_t> terminalNumbers;
+  for (size_t t = 0; t < terminalNames.size(); t++) {
+    terminalNumbers[terminalNames[t]] = t;
+  }
+  lambda = terminalNumbers.at(LAMBDA);
+  end = terminalNumbers.at("$");
+
+  std::unordered_map<std::string, size_t> nonTerminalNumbers;
+  for (size_t n = 0; n < nonTerminalSetOrder.size(); n++) {
+    nonTerminalNumbers[nonTerminalSetOrder[n]] = n;
+  }
+
+  productions.clear();
+  productionsOf.assign(nonTerminalSetOrder.size(), {});
+  for (const auto& [left, right] : grammar) {
+    Production production{nonTerminalNumbers.at(left), {}};
+    for (const auto& token : right) {
+      if (token == LAMBDA) {
+        continue;
+      }
+      if (isTerminal(token)) {
+        production.right.push_back({true, terminalNumbers.at(token)});
+        continue;
+      }
 
-    // If the last non-terminal on the right side contains a LAMBDA, that means
-    // LAMBDA is a member of first.
-    if (lastLambda) {
-      firstMembers[nonTerminal].insert(LAMBDA);
+      const auto number = nonTerminalNumbers.find(token);
+      if (number == nonTerminalNumbers.end()) {
+        throw std::invalid_argument("no grammar entry for " + token);
+      }
+      production.right.push_back({false, number->second});
     }
+
+    productionsOf[production.left].push_back(productions.size());
+    productions.push_back(std::move(production));
   }
 }
 
-std::unordered_set<std::string> Grammar::getFirstFromRightSide(
-    const std::vector<std::string>& vector) const {
-  std::unordered_set<std::string> firstSet;
-  for (const auto& token : vector) {
-    if (isNonTerminal(token)) {
-      // Adds all terminals from first(token)
-      for (const auto& terminals : firstMembers.at(token)) {
-        firstSet.insert(terminals);
+void Grammar::findMembersOfFirst() {
+  const size_t count = nonTerminalSetOrder.size();
+  nullable = Bitset(count);
+  firstMembers.assign(count, Bitset(terminalNames.size()));
+
+  // users holds the productions that each non-terminal is on the right side
+  // of, which must be evaluated again when its members of first grow.
+  std::vector<std::vector<size_t>> users(count);
+  for (size_t p = 0; p < productions.size(); p++) {
+    for (const auto& symbol : productions[p].right) {
+      if (symbol.terminal) {
+        continue;
+      }
+      auto& of = users[symbol.index];
+      if (of.empty() || of.back() != p) {
+        of.push_back(p);
       }
+    }
+  }
 
-      // If LAMBDA is not here, then don't continue to next terminal /
-      // non-terminal
-      if (firstMembers.at(token).find(LAMBDA) == firstMembers.at(token).end()) {
-        break;
+  std::vector<size_t> worklist(productions.size());
+  std::vector<bool> queued(productions.size(), true);
+  for (size_t p = 0; p < productions.size(); p++) {
+    worklist[p] = productions.size() - 1 - p;
+  }
+
+  Bitset first(terminalNames.size());
+  while (!worklist.empty()) {
+    const size_t p = worklist.back();
+    worklist.pop_back();
+    queued[p] = false;
+
+    const size_t left = productions[p].left;
+    first.clear();
+    bool grew = false;
+    if (getFirstFromRightSide(productions[p].right, first)) {
+      grew = nullable.set(left);
+    }
+    grew = firstMembers[left].merge(first) || grew;
+    if (!grew) {
+      continue;
+    }
+
+    for (const auto user : users[left]) {
+      if (!queued[user]) {
+        queued[user] = true;
+        worklist.push_back(user);
       }
-    } else {
-      // Only insert first terminal to first set
-      firstSet.insert(token);
-      break;
     }
   }
+}
+
+bool Grammar::getFirstFromRightSide(const std::vector<NumberedSymbol>& symbols,
+                                    Bitset& first) const {
+  for (const auto& symbol : symbols) {
+    if (symbol.terminal) {
+      // Only insert first terminal to first set
+      first.set(symbol.index);
+      return false;
+    }
 
-  return firstSet;
+    // Adds all terminals from first(symbol). If it is not nullable, then don't
+    // continue to the next terminal / non-terminal.
+    first.merge(firstMembers[symbol.index]);
+    if (!nullable.test(symbol.index)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 void Grammar::findMembersOfFollow() {
+  const size_t count = nonTerminalSetOrder.size();
+  followMembers.assign(count, Bitset(terminalNames.size()));
+
   // First Rule
   // Starting grammar rule always has '$' as a member of follow.
-  followMembers[nonTerminalSetOrder.front()].insert("$");
+  followMembers[0].set(end);
 
-  for (const auto& nonTerminal : nonTerminalSetOrder) {
-    findFollowHelper(nonTerminal);
-  }
+  // Second Rule
+  // Adds the members of first of what follows each non-terminal on a right
+  // side, which is found by walking the right side backwards.
+  // Third Rule
+  // Notes that the members of follow of the left side flow to each
+  // non-terminal that is only followed by nullable symbols.
+  std::vector<std::vector<size_t>> flowsTo(count);
+  Bitset trailer(terminalNames.size());
+  for (const auto& production : productions) {
+    trailer.clear();
+    bool nullableTrailer = true;
+    for (auto it = production.right.rbegin(); it != production.right.rend();
+         ++it) {
+      if (it->terminal) {
+        trailer.clear();
+        trailer.set(it->index);
+        nullableTrailer = false;
+        continue;
+      }
 
-  // Third Rule Post Processing, which replaces all non-terminals within the set
-  bool done = false;
-  while (!done) {
-    done = true;
-    for (const auto& pair : followMembers) {
-      if (containsPlaceholderFollow(pair.first)) {
-        done = false;
-      } else {
-        replacePlaceholderInFollow(pair.first);
+      followMembers[it->index].merge(trailer);
+      if (nullableTrailer && it->index != production.left) {
+        flowsTo[production.left].push_back(it->index);
       }
+      if (!nullable.test(it->index)) {
+        trailer.clear();
+        nullableTrailer = false;
+      }
+      trailer.merge(firstMembers[it->index]);
     }
   }
-}
 
-void Grammar::findFollowHelper(const std::string& nonTerminal) {
-  if (!isNonTerminal(nonTerminal)) {
-    return;
+  // Let the members of follow flow until nothing changes.
+  std::vector<size_t> worklist(count);
+  std::vector<bool> queued(count, true);
+  for (size_t n = 0; n < count; n++) {
+    worklist[n] = count - 1 - n;
   }
+  while (!worklist.empty()) {
+    const size_t from = worklist.back();
+    worklist.pop_back();
+    queued[from] = false;
 
-  // Second Rule
-  // Adds the members of first of the non-terminal that directly follows the
-  // specified non-terminal.
-  for (const auto& pair : grammar) {
-    for (unsigned int index = 0; index < pair.second.size() - 1; ++index) {
-      if (index + 1 >= pair.second.size()) {
-        break;
+    for (const auto to : flowsTo[from]) {
+      if (followMembers[to].merge(followMembers[from]) && !queued[to]) {
+        queued[to] = true;
+        worklist.push_back(to);
       }
+    }
+  }
+}
+
+void Grammar::findLexicalRules() {
+  const size_t count = nonTerminalSetOrder.size();
 
-      if (pair.second.at(index) != nonTerminal) {
+  // A non-terminal only derives parts of words if every symbol of its
+  // grammar entries is a word character or such a non-terminal, which is
+  // repeated until nothing changes.
+  const auto wordCharacter = [&](size_t t) {
+    return terminalNames[t].size() == 1 &&
+           Lexer::isWordCharacter(terminalNames[t][0]);
+  };
+  std::vector<bool> characters(count, true);
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (const auto& production : productions) {
+      if (!characters[production.left]) {
         continue;
       }
-
-      // Get First(B) where B are the tokens to the right.
-      auto rightOfCurrent = std::vector<std::string>(
-          pair.second.begin() + index + 1, pair.second.end());
-      for (const auto& terminals : getFirstFromRightSide(rightOfCurrent)) {
-        if (terminals == LAMBDA) {
-          continue;
+      for (const auto& symbol : production.right) {
+        if (symbol.terminal ? !wordCharacter(symbol.index)
+                            : !characters[symbol.index]) {
+          characters[production.left] = false;
+          changed = true;
+          break;
         }
-        followMembers[nonTerminal].insert(terminals);
       }
     }
   }
 
-  // Third Rule Pre Processing
-  // This places non-terminals within the follow set if it needs to fetch the
-  // members of follow for that non-terminal.
-  for (const auto& pair : grammar) {
-    bool previousTokenContainsLambda = true;
-    for (auto iterator = pair.second.rbegin(); iterator != pair.second.rend();
-         ++iterator) {
-      if (*iterator == nonTerminal && previousTokenContainsLambda) {
-        // Mark this non-terminal to insert the follow(pair.first) into the set.
-        if (pair.first != nonTerminal) {
-          followMembers[nonTerminal].insert(pair.first);
+  std::vector<bool> used(count);
+  for (const auto& production : productions) {
+    if (characters[production.left]) {
+      continue;
+    }
+    for (const auto& symbol : production.right) {
+      if (!symbol.terminal && characters[symbol.index]) {
+        used[symbol.index] = true;
+      }
+    }
+  }
+
+  lexicalRules.clear();
+  for (size_t n = 0; n < count; n++) {
+    LexicalRule rule;
+    if (used[n] && compileLexicalRule(n, rule)) {
+      lexicalRules.push_back(std::move(rule));
+    }
+  }
+}
+
+bool Grammar::compileLexicalRule(size_t nonTerminal, LexicalRule& rule) const {
+  nfa automaton;
+  const uint32_t accept = automaton.add();
+
+  // expand adds the states that derive the strings of non-terminal n followed
+  // by whatever exit leads to, and returns the state they start from. The
+  // same non-terminal followed by the same exit starts from the same state.
+  std::map<std::pair<size_t, uint32_t>, uint32_t> entries;
+  std::vector<std::optional<uint32_t>> expanding(nonTerminalSetOrder.size());
+  const auto expand = [&](const auto& expand, size_t n,
+                          uint32_t exit) -> std::optional<uint32_t> {
+    const auto found = entries.find({n, exit});
+    if (found != entries.end()) {
+      return found->second;
+    }
+    if (expanding[n] || automaton.states.size() >= nfa::MAX_STATES) {
+      return std::nullopt;
+    }
+
+    const uint32_t entry = automaton.add();
+    entries[{n, exit}] = entry;
+    expanding[n] = exit;
+    for (const auto p : productionsOf[n]) {
+      // The right side is expanded backwards, from the state it leads to.
+      uint32_t next = exit;
+      const auto& right = productions[p].right;
+      for (auto it = right.rbegin(); it != right.rend(); ++it) {
+        if (it->terminal) {
+          const uint32_t from = automaton.add();
+          const unsigned char c = terminalNames[it->index][0];
+          automaton.states[from].moves.push_back({c, next});
+          next = from;
+          continue;
         }
-        break;
-      } else if (isNonTerminal(*iterator)) {
-        if (firstMembers[*iterator].find(LAMBDA) !=
-            firstMembers[*iterator].end()) {
-          previousTokenContainsLambda = true;
-        } else {
-          previousTokenContainsLambda = false;
+        const auto from = expand(expand, it->index, next);
+        if (!from) {
+          return std::nullopt;
         }
-      } else {
-        // Only a terminal token is at the end of the grammar.
-        break;
+        next = *from;
       }
+      automaton.states[entry].lambdas.push_back(next);
     }
+    expanding[n].reset();
+    return entry;
+  };
+  const auto start = expand(expand, nonTerminal, accept);
+  if (!start) {
+    return false;
   }
-}
 
-void Grammar::replacePlaceholderInFollow(const std::string& placeholder) {
-  for (const auto& pair : followMembers) {
-    if (pair.second.find(placeholder) == pair.second.end()) {
-      continue;
+  // Each state of the DFA is a set of states of the NFA, found by following
+  // every byte from the states found before.
+  std::map<std::vector<uint32_t>, uint16_t> numbers;
+  std::vector<std::vector<uint32_t>> sets = {{}, {*start}};
+  automaton.close(sets[LexicalRule::START]);
+  numbers[sets[LexicalRule::DEAD]] = LexicalRule::DEAD;
+  numbers[sets[LexicalRule::START]] = LexicalRule::START;
+
+  rule.transitions.assign(2 * 256, LexicalRule::DEAD);
+  std::array<std::vector<uint32_t>, 256> targets;
+  for (size_t d = LexicalRule::START; d < sets.size(); d++) {
+    for (const auto s : sets[d]) {
+      for (const auto& [c, to] : automaton.states[s].moves) {
+        targets[c].push_back(to);
+      }
     }
+    for (size_t c = 0; c < 256; c++) {
+      if (targets[c].empty()) {
+        continue;
+      }
+      auto target = std::move(targets[c]);
+      targets[c].clear();
+      automaton.close(target);
+      target.erase(std::unique(target.begin(), target.end()), target.end());
 
-    followMembers[pair.first].erase(placeholder);
-    for (const auto& terminals : followMembers[placeholder]) {
-      followMembers[pair.first].insert(terminals);
+      auto [it, added] = numbers.try_emplace(target, sets.size());
+      if (added) {
+        if (sets.size() >= LexicalRule::MAX_STATES) {
+          return false;
+        }
+        sets.push_back(target);
+        rule.transitions.resize(sets.size() * 256, LexicalRule::DEAD);
+      }
+      rule.transitions[d * 256 + c] = it->second;
     }
   }
-}
 
-bool Grammar::containsPlaceholderFollow(const std::string& nonTerminal) const {
-  for (const auto& terminal : followMembers.at(nonTerminal)) {
-    if (isNonTerminal(terminal)) {
-      return true;
+  rule.nonTerminal = nonTerminalSetOrder[nonTerminal];
+  rule.accepting = Bitset(sets.size());
+  for (size_t d = 0; d < sets.size(); d++) {
+    if (std::binary_search(sets[d].begin(), sets[d].end(), accept)) {
+      rule.accepting.set(d);
     }
   }
-  return false;
+  followMembers[nonTerminal].forEach([&](size_t t) {
+    const Symbols::ID symbol = Symbols::intern(terminalNames[t]);
+    if (symbol >= rule.follow.size()) {
+      rule.follow.resize(symbol + 1);
+    }
+    rule.follow[symbol] = true;
+  });
+  return true;
 }
 
 void Grammar::prepareGrammar(std::string path) {
@@ -325,6 +932,11 @@ void Grammar::prepareGrammar(std::string path) {
 void Grammar::prepareGrammar(std::istream& file) {
   grammar = std::vector<std::pair<std::string, std::vector<std::string>>>();
 
+  // The lines are read first, so that groups are not named like non-terminals
+  // declared later.
+  std::vector<std::pair<std::string, std::vector<std::string>>> lines;
+  std::vector<std::vector<std::string>> declarations;  // of operators
+  std::unordered_set<std::string> declared;
   std::string line;
   while (std::getline(file, line)) {
     std::vector<std::string> entries;
@@ -337,30 +949,387 @@ void Grammar::prepareGrammar(std::istream& file) {
     if (entries.size() <= 2) {
       continue;
     }
+    if (entries[0] == "%left" || entries[0] == "%right") {
+      declarations.push_back(std::move(entries));
+      continue;
+    }
+    if (entries[1] != "->") {
+      throw std::invalid_argument(line);
+    }
+    declared.insert(entries[0]);
+    lines.emplace_back(line, std::move(entries));
+  }
+
+  for (const auto& [line, entries] : lines) {
+    // Groups of <dec> are named <dec-prime>, <dec-prime-2>, and so on.
+    const std::string& left = entries[0];
+    const auto name = [&]() {
+      const std::string stem = left.substr(0, left.size() - 1) + "-prime";
+      std::string group = stem + ">";
+      for (size_t n = 2; declared.contains(group) || groupsSet.contains(group);
+           n++) {
+        group = stem + "-" + std::to_string(n) + ">";
+      }
+      groupsSet.insert(group);
+      return group;
+    };
+    ebnfReader reader(line, entries, name);
 
     // Update non-terminal & terminal sets
-    auto result = nonTerminalsSet.insert(entries[0]);
-    if (result.second) {
-      nonTerminalSetOrder.push_back(entries[0]);
+    if (nonTerminalsSet.insert(left).second) {
+      nonTerminalSetOrder.push_back(left);
     }
-    for (auto iterator = entries.begin() + 2; iterator != entries.end();
-         ++iterator) {
-      if (isTerminal(*iterator)) {
-        terminalsSet.insert(*iterator);
+    for (const auto& entry : reader.entries) {
+      if (nonTerminalsSet.insert(entry.first).second) {
+        nonTerminalSetOrder.push_back(entry.first);
       }
     }
 
     // Update Grammar Table
-    if (entries.size() >= 3 && entries[1] == "->") {
-      auto newEntries =
-          std::vector<std::string>(entries.begin() + 2, entries.end());
-      auto pair = std::pair<std::string, std::vector<std::string>>(entries[0],
-                                                                   newEntries);
+    const size_t first = grammar.size();
+    grammar.emplace_back(left, std::move(reader.right));
+    std::move(reader.entries.begin(), reader.entries.end(),
+              std::back_inserter(grammar));
+    for (size_t p = first; p < grammar.size(); p++) {
+      for (const auto& token : grammar[p].second) {
+        if (isTerminal(token)) {
+          terminalsSet.insert(token);
+        }
+      }
+    }
+  }
 
-      grammar.push_back(pair);
-      continue;
+  // Each declaration of an expression binds tighter than the ones before.
+  std::unordered_map<std::string, uint32_t> precedences;
+  for (const auto& declaration : declarations) {
+    const auto& nonTerminal = declaration[1];
+    const uint32_t precedence = ++precedences[nonTerminal];
+    for (size_t i = 2; i < declaration.size(); i++) {
+      operators.push_back({nonTerminal, declaration[i], precedence,
+                           declaration[0] == "%right"});
+    }
+  }
+  checkOperators();
+}
+
+void Grammar::checkOperators() const {
+  std::map<std::string, std::set<std::string>> expressions;
+  for (const auto& op : operators) {
+    if (!expressions[op.nonTerminal].insert(op.terminal).second) {
+      throw std::invalid_argument("operator " + op.terminal +
+                                  " declared twice for " + op.nonTerminal);
+    }
+  }
+
+  // An expression <e> has the only grammar entry <e> -> <x> G, and G is a
+  // repetition with the grammar entries G -> op <x> G of its operators.
+  for (const auto& [nonTerminal, terminals] : expressions) {
+    const auto fail = [&nonTerminal = nonTerminal]() {
+      return std::invalid_argument(
+          nonTerminal + " must be an operand followed by a repetition of " +
+          "its operators, each followed by the operand");
+    };
+    const auto entry = std::find_if(
+        grammar.begin(), grammar.end(),
+        [&](const GrammarEntry& entry) { return entry.first == nonTerminal; });
+    if (entry == grammar.end() ||
+        std::any_of(entry + 1, grammar.end(),
+                    [&](const GrammarEntry& other) {
+                      return other.first == nonTerminal;
+                    }) ||
+        entry->second.size() != 2 || !groupsSet.contains(entry->second[1])) {
+      throw fail();
+    }
+
+    const auto& operand = entry->second[0];
+    const auto& group = entry->second[1];
+    std::set<std::string> found;
+    for (const auto& [left, right] : grammar) {
+      if (left != group || right == std::vector<std::string>{LAMBDA}) {
+        continue;
+      }
+      if (right.size() != 3 || right[1] != operand || right[2] != group ||
+          !terminals.contains(right[0]) || !found.insert(right[0]).second) {
+        throw fail();
+      }
+    }
+    if (found != terminals) {
+      throw fail();
+    }
+  }
+}
+
+Grammar::Grammar(const Tables& tables) {
+  const auto fail = []() {
+    return std::invalid_argument("inconsistent grammar tables");
+  };
+  const size_t rows = tables.nonTerminals.size();
+  const size_t columns = tables.terminals.size();
+  const size_t entries = tables.lefts.size();
+  const size_t firstWords = Bitset(columns).data().size();
+
+  // Checks everything that would be read out of bounds later.
+  const auto lambdaAt = std::find(tables.terminals.begin(),
+                                  tables.terminals.end(), LAMBDA);
+  const auto endAt =
+      std::find(tables.terminals.begin(), tables.terminals.end(), "$");
+  if (rows == 0 || lambdaAt == tables.terminals.end() ||
+      endAt == tables.terminals.end() ||
+      tables.starts.size() != entries + 1 || tables.starts.front() != 0 ||
+      tables.starts.back() != tables.rights.size() ||
+      !std::is_sorted(tables.starts.begin(), tables.starts.end()) ||
+      tables.nullable.size() != Bitset(rows).data().size() ||
+      tables.first.size() != rows * firstWords ||
+      tables.follow.size() != rows * firstWords ||
+      tables.offsets.size() != rows ||
+      (!tables.checks.empty() && tables.checks.size() != tables.cells.size()) ||
+      entries >= CompiledTable::ERROR) {
+    throw fail();
+  }
+  const auto outside = [](const auto& values, size_t bound) {
+    return std::any_of(values.begin(), values.end(),
+                       [&](auto value) { return value >= bound; });
+  };
+  if (outside(tables.grammarTerminals, columns) ||
+      outside(tables.groups, rows) || outside(tables.lefts, rows) ||
+      outside(tables.rights, rows + columns) ||
+      tables.operators.size() % 3 != 0) {
+    throw fail();
+  }
+  for (size_t i = 0; i < tables.operators.size(); i += 3) {
+    if (tables.operators[i] >= rows || tables.operators[i + 1] >= columns) {
+      throw fail();
+    }
+  }
+  for (const auto offset : tables.offsets) {
+    if (tables.checks.empty() && offset + columns > tables.cells.size()) {
+      throw fail();
+    }
+  }
+  for (const auto cell : tables.cells) {
+    if (cell != CompiledTable::ERROR && cell >= entries) {
+      throw fail();
+    }
+  }
+
+  nonTerminalSetOrder.assign(tables.nonTerminals.begin(),
+                             tables.nonTerminals.end());
+  nonTerminalsSet.insert(nonTerminalSetOrder.begin(),
+                         nonTerminalSetOrder.end());
+  terminalNames.assign(tables.terminals.begin(), tables.terminals.end());
+  for (const auto t : tables.grammarTerminals) {
+    terminalsSet.insert(terminalNames[t]);
+  }
+  for (const auto n : tables.groups) {
+    groupsSet.insert(nonTerminalSetOrder[n]);
+  }
+  for (size_t i = 0; i + 2 < tables.operators.size(); i += 3) {
+    operators.push_back({nonTerminalSetOrder[tables.operators[i]],
+                         terminalNames[tables.operators[i + 1]],
+                         tables.operators[i + 2] >> 1,
+                         (tables.operators[i + 2] & 1) == 1});
+  }
+  lambda = lambdaAt - tables.terminals.begin();
+  end = endAt - tables.terminals.begin();
+
+  grammar.resize(entries);
+  productions.resize(entries);
+  productionsOf.resize(rows);
+  for (size_t p = 0; p < entries; p++) {
+    const size_t left = tables.lefts[p];
+    grammar[p].first = nonTerminalSetOrder[left];
+    productions[p].left = left;
+    productionsOf[left].push_back(p);
+
+    auto& right = grammar[p].second;
+    right.reserve(tables.starts[p + 1] - tables.starts[p]);
+    for (size_t i = tables.starts[p]; i < tables.starts[p + 1]; i++) {
+      const size_t symbol = tables.rights[i];
+      if (symbol < rows) {
+        right.push_back(nonTerminalSetOrder[symbol]);
+        productions[p].right.push_back({false, symbol});
+        continue;
+      }
+      right.push_back(terminalNames[symbol - rows]);
+      if (symbol - rows != lambda) {
+        productions[p].right.push_back({true, symbol - rows});
+      }
+    }
+  }
+
+  const auto readBitset = [](size_t size, std::span<const uint64_t> words) {
+    Bitset bitset(size);
+    std::copy(words.begin(), words.begin() + bitset.data().size(),
+              bitset.data().begin());
+    return bitset;
+  };
+  nullable = readBitset(rows, tables.nullable);
+  for (size_t n = 0; n < rows; n++) {
+    firstMembers.push_back(
+        readBitset(columns, tables.first.subspan(n * firstWords)));
+    followMembers.push_back(
+        readBitset(columns, tables.follow.subspan(n * firstWords)));
+  }
+
+  // Every symbol of the grammar is one of its names.
+  for (const auto& symbol : {std::string("$"), LAMBDA, SIGMA}) {
+    Symbols::intern(symbol);
+  }
+  for (const auto& name : nonTerminalSetOrder) {
+    Symbols::intern(name);
+  }
+  for (const auto& name : terminalNames) {
+    Symbols::intern(name);
+  }
+
+  auto table = std::make_shared<CompiledTable>(indexParsingTable());
+  table->offsets.assign(tables.offsets.begin(), tables.offsets.end());
+  table->checks.assign(tables.checks.begin(), tables.checks.end());
+  table->cells.assign(tables.cells.begin(), tables.cells.end());
+  cachedTable = table;
+
+  checkOperators();
+  findLexicalRules();
+}
+
+Grammar::OwnedTables Grammar::exportTables() const {
+  OwnedTables tables;
+  tables.nonTerminals.assign(nonTerminalSetOrder.begin(),
+                             nonTerminalSetOrder.end());
+  tables.terminals.assign(terminalNames.begin(), terminalNames.end());
+  for (size_t t = 0; t < terminalNames.size(); t++) {
+    if (terminalsSet.contains(terminalNames[t])) {
+      tables.grammarTerminals.push_back(t);
     }
+  }
+
+  const size_t rows = nonTerminalSetOrder.size();
+  for (size_t n = 0; n < rows; n++) {
+    if (groupsSet.contains(nonTerminalSetOrder[n])) {
+      tables.groups.push_back(n);
+    }
+  }
+  for (const auto& op : operators) {
+    const auto n = std::find(nonTerminalSetOrder.begin(),
+                             nonTerminalSetOrder.end(), op.nonTerminal);
+    const auto t =
+        std::find(terminalNames.begin(), terminalNames.end(), op.terminal);
+    tables.operators.push_back(n - nonTerminalSetOrder.begin());
+    tables.operators.push_back(t - terminalNames.begin());
+    tables.operators.push_back(op.precedence << 1 | op.rightAssociative);
+  }
+  for (size_t p = 0; p < grammar.size(); p++) {
+    tables.lefts.push_back(productions[p].left);
+    tables.starts.push_back(tables.rights.size());
+
+    // Productions leave λ out of right sides, which the grammar keeps.
+    auto numbered = productions[p].right.begin();
+    for (const auto& token : grammar[p].second) {
+      if (token == LAMBDA) {
+        tables.rights.push_back(rows + lambda);
+        continue;
+      }
+      tables.rights.push_back(numbered->terminal ? rows + numbered->index
+                                                 : numbered->index);
+      ++numbered;
+    }
+  }
+  tables.starts.push_back(tables.rights.size());
+
+  const auto words = nullable.data();
+  tables.nullable.assign(words.begin(), words.end());
+  for (size_t n = 0; n < rows; n++) {
+    const auto first = firstMembers[n].data();
+    tables.first.insert(tables.first.end(), first.begin(), first.end());
+    const auto follow = followMembers[n].data();
+    tables.follow.insert(tables.follow.end(), follow.begin(), follow.end());
+  }
+
+  auto table = compileParsingTable();
+  tables.offsets.assign(table.offsets.begin(), table.offsets.end());
+  tables.checks = std::move(table.checks);
+  tables.cells = std::move(table.cells);
+  return tables;
+}
+
+bool Grammar::loadCache(const std::string& path, uint64_t key) {
+  const mappedFile file(path);
+  const auto bytes = file.bytes();
+
+  cacheHeader header;
+  if (bytes.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const auto payload = bytes.substr(sizeof(header));
+  if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header.version != CACHE_VERSION ||
+      header.byteOrder != CACHE_BYTE_ORDER || header.key != key ||
+      header.size != payload.size() || header.checksum != hash(payload)) {
+    return false;
+  }
+
+  // The names point into the mapped file until the grammar copies them.
+  try {
+    cacheReader in{payload};
+    OwnedTables tables;
+    tables.nonTerminals = in.strings();
+    tables.terminals = in.strings();
+    tables.grammarTerminals = in.array<uint32_t>();
+    tables.groups = in.array<uint32_t>();
+    tables.operators = in.array<uint32_t>();
+    tables.lefts = in.array<uint32_t>();
+    tables.starts = in.array<uint32_t>();
+    tables.rights = in.array<uint32_t>();
+    tables.nullable = in.array<uint64_t>();
+    tables.first = in.array<uint64_t>();
+    tables.follow = in.array<uint64_t>();
+    tables.offsets = in.array<uint64_t>();
+    tables.checks = in.array<uint32_t>();
+    tables.cells = in.array<CompiledTable::Production>();
+    *this = Grammar(tables.view());
+    return true;
+  } catch (const std::out_of_range&) {
+    return false;
+  } catch (const std::invalid_argument&) {
+    return false;
+  }
+}
+
+void Grammar::saveCache(const std::string& path, uint64_t key) const {
+  const auto tables = exportTables();
+  cacheWriter out;
+  out.strings(tables.nonTerminals);
+  out.strings(tables.terminals);
+  out.array<uint32_t>(tables.grammarTerminals);
+  out.array<uint32_t>(tables.groups);
+  out.array<uint32_t>(tables.operators);
+  out.array<uint32_t>(tables.lefts);
+  out.array<uint32_t>(tables.starts);
+  out.array<uint32_t>(tables.rights);
+  out.array<uint64_t>(tables.nullable);
+  out.array<uint64_t>(tables.first);
+  out.array<uint64_t>(tables.follow);
+  out.array<uint64_t>(tables.offsets);
+  out.array<uint32_t>(tables.checks);
+  out.array<CompiledTable::Production>(tables.cells);
+
+  cacheHeader header;
+  std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  header.key = key;
+  header.size = out.bytes.size();
+  header.checksum = hash(out.bytes);
 
-    throw std::invalid_argument(line);
+  // Other processes may be reading or writing the cache at the same time, so
+  // it is written to a file of our own and renamed into place.
+  const std::string temporary = path + "." + std::to_string(::getpid());
+  std::ofstream file(temporary, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(out.bytes.data(), out.bytes.size());
+  file.close();
+  if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
   }
 }
@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "bitset.hpp"
+#include "symbols.hpp"
+
 const std::string LAMBDA = "λ";
 const std::string SIGMA = "σ";
 
@@ -17,20 +24,99 @@ class Grammar {
                              std::map<std::string, std::vector<std::string>>>
       ParsingTable;
 
+  class CompiledTable;
+  class LexicalRule;
+  struct Tables;
+  struct OwnedTables;
+
+  // Operator is a binary operator of an expression: a non-terminal whose only
+  // grammar entry is an operand followed by a repetition of operators, each
+  // followed by the operand. Parsers fold what an expression parses into
+  // binary nodes by the precedence of its operators.
+  struct Operator {
+    std::string nonTerminal;
+    std::string terminal;
+    uint32_t precedence;  // operators declared later bind tighter, from 1
+    bool rightAssociative;
+  };
+
+  // TableLayout is how compileParsingTable lays out the cells of the table.
+  enum TableLayout {
+    AUTO,   // COMB if the table has more than COMB_CELLS cells, else DENSE
+    DENSE,  // every cell of every row
+    COMB,   // rows overlapped by row displacement, leaving out empty cells
+  };
+  static constexpr size_t COMB_CELLS = 1 << 16;
+
   /**
    * Instantiates a new GrammarParser object.
    * Grammar from the text file must contain NO left-recursion, no ambiguity,
-   * and perform left-factoring when possible.
+   * and perform left-factoring when possible. Right sides may contain groups:
+   * { α | β } repeats any of its alternatives, [ α | β ] is optional, and
+   * <x>* is { <x> }. Each group becomes a non-terminal of its own, named
+   * after the left side like <dec-prime>. Lines like %left <expr> + - and
+   * %right <expr> ^ declare the operators of an expression, from the lowest
+   * precedence to the highest. Every symbol of the grammar, along with $, λ
+   * and σ, is interned in Symbols.
+   * @throws std::invalid_argument if a line or an expression is malformed
    */
   Grammar(std::istream& grammarFile);
   Grammar(std::string grammarPath);
 
+  /**
+   * Instantiates a new GrammarParser object like Grammar(grammarPath), but
+   * reuses what was computed from the grammar last time through a cache file.
+   * The cache file is only used if it was written for the same grammar text
+   * by the same version of the cache format and is intact; otherwise the
+   * grammar is processed again and the cache file replaced. Failing to write
+   * the cache file is not an error.
+   * @param grammarPath Text File Location of the grammar
+   * @param cachePath File Location of the cache
+   */
+  Grammar(std::string grammarPath, std::string cachePath);
+
+  /**
+   * Instantiates a new GrammarParser object from the tables exported from
+   * another one, without processing the grammar again. This is how grammars
+   * are loaded from cache files and compiled into programs.
+   * @param tables Tables from exportTables
+   * @throws std::invalid_argument if the tables are inconsistent
+   */
+  Grammar(const Tables& tables);
+
+  /**
+   * Exports everything computed from the grammar as flat tables. The names in
+   * them point into the grammar.
+   * @return Tables of the grammar.
+   */
+  OwnedTables exportTables() const;
+
   /**
    * Constructs a Predictive Parsing Table based on the grammar.
    * @return Parsing Table Structure.
    */
   ParsingTable constructPredictiveParsingTable() const;
 
+  /**
+   * Constructs the Predictive Parsing Table indexed by interned symbols, with
+   * a grammar entry number in each cell instead of a copy of its right side.
+   * The cells are the same as those of constructPredictiveParsingTable.
+   * @param layout How the cells are laid out in memory.
+   * @return Compiled Parsing Table.
+   */
+  CompiledTable compileParsingTable(TableLayout layout = AUTO) const;
+
+  /**
+   * Returns the lexical rules of the grammar. A non-terminal is a lexical rule
+   * if it only derives strings of word characters, which the lexer never
+   * splits into separate lexemes, through a regular language, and it is used
+   * by a non-terminal that does not.
+   * @return Lexical rules in the order of their non-terminals.
+   */
+  const std::vector<LexicalRule>& getLexicalRules() const {
+    return this->lexicalRules;
+  }
+
   /**
    * Returns the Starting Grammar Rule from the grammar
    * @return Starting Grammar Rule.
@@ -55,6 +141,33 @@ class Grammar {
     return this->nonTerminalsSet;
   }
 
+  /**
+   * Returns the non-terminals that groups of the grammar were turned into.
+   * Parsers add what a group derives to the node of the non-terminal it is
+   * in, so that repetitions become siblings instead of nested nodes.
+   * @return Set of non-terminals.
+   */
+  const std::unordered_set<std::string>& getGroups() const {
+    return this->groupsSet;
+  }
+
+  /**
+   * Returns the members of follow of a non-terminal.
+   * @param nonTerminal Non-terminal of the grammar
+   * @return Terminals that may follow the non-terminal, including $, or none
+   * if it is not a non-terminal of the grammar.
+   */
+  std::vector<std::string> getMembersOfFollow(
+      const std::string& nonTerminal) const;
+
+  /**
+   * Returns the operators of the expressions of the grammar.
+   * @return Operators in the order they were declared.
+   */
+  const std::vector<Operator>& getOperators() const {
+    return this->operators;
+  }
+
   /**
    * Checks if the token is a non-terminal. Non-terminals are defined using the
    * '<' and '>' symbols.
@@ -91,52 +204,96 @@ class Grammar {
   void printPredictiveParsingTable() const;
 
  protected:
+  // NumberedSymbol is a terminal or non-terminal by its number.
+  struct NumberedSymbol {
+    bool terminal;
+    size_t index;
+  };
+
+  // Production is a grammar entry with its symbols numbered and λ left out.
+  struct Production {
+    size_t left;
+    std::vector<NumberedSymbol> right;
+  };
+
   /**
-   * Method that computes the members of first of the given grammar.
+   * Numbers the terminals and non-terminals of the grammar densely, so that
+   * sets of them can be stored as bitsets, and numbers every grammar entry.
    */
-  void findMembersOfFirst();
+  void numberSymbols();
 
   /**
-   * Helper function that computes the members of first of a given non-terminal.
-   * @param nonTerminal Specified non-terminal
+   * Method that computes which non-terminals are nullable and their members of
+   * first. Every production is evaluated once, then again whenever the members
+   * of first of a non-terminal on its right side grow, until nothing changes.
    */
-  void findFirstHelper(const std::string& nonTerminal);
+  void findMembersOfFirst();
 
   /**
-   * Method that returns the members of first of a string of
-   * terminals/non-terminals. Note: This method only works AFTER the members of
-   * first are computed for the grammar.
-   * @param vector String of terminals and/or non-terminals
-   * @return Set of first members
+   * Method that adds the members of first of a string of terminals and
+   * non-terminals to the given set, leaving out λ. Note: This method only works
+   * AFTER the members of first are computed for the grammar.
+   * @param symbols String of terminals and/or non-terminals
+   * @param first Set of first members to add to
+   * @return If the string is nullable
    */
-  std::unordered_set<std::string> getFirstFromRightSide(
-      const std::vector<std::string>& vector) const;
+  bool getFirstFromRightSide(const std::vector<NumberedSymbol>& symbols,
+                             Bitset& first) const;
 
   /**
-   * Method that computes the members of follow of the given grammar.
+   * Method that computes the members of follow of the given grammar. Follow
+   * members flow from a non-terminal to the non-terminals that end one of its
+   * productions, which is repeated over a worklist until nothing changes.
    */
   void findMembersOfFollow();
 
   /**
-   * Helper function that computes the members of follow of a given
-   * non-terminal.
-   * @param nonTerminal Specified non-terminal
+   * Method that finds the lexical rules of the grammar and compiles each one
+   * into a DFA. Note: This method only works AFTER the members of follow are
+   * computed for the grammar.
    */
-  void findFollowHelper(const std::string& nonTerminal);
+  void findLexicalRules();
 
   /**
-   * Replaces all instances of the non-terminal specified with their respective
-   * follow members.
-   * @param placeholder Specified non-terminal
+   * Compiles a non-terminal that only derives word characters into a DFA,
+   * through an NFA that its grammar entries are expanded into. A non-terminal
+   * derived again within its own expansion becomes a loop if the same string
+   * follows it both times; any other recursion makes the language not regular.
+   * @param nonTerminal Number of the non-terminal
+   * @param rule Lexical rule to fill in
+   * @return If the language is regular and its DFA is small enough.
    */
-  void replacePlaceholderInFollow(const std::string& placeholder);
+  bool compileLexicalRule(size_t nonTerminal, LexicalRule& rule) const;
 
   /**
-   * Checks if there is a non-terminal within its follow set.
-   * @param nonTerminal Specified non-terminal
-   * @return If the follow set contains a non-terminal.
+   * Calls f with the non-terminal, terminal and grammar entry numbers of every
+   * cell of the Predictive Parsing Table, in the order that the cells are
+   * filled in. A later call for the same cell overrides an earlier one.
    */
-  bool containsPlaceholderFollow(const std::string& nonTerminal) const;
+  template <class F>
+  void forEachTableCell(F f) const;
+
+  /**
+   * Returns a Compiled Parsing Table with its symbols indexed and the right
+   * sides of the grammar entries stored, but no cells.
+   */
+  CompiledTable indexParsingTable() const;
+
+  /**
+   * Loads everything computed from the grammar from a cache file.
+   * @param path File Location of the cache
+   * @param key Hash of the grammar text
+   * @return If the cache file was usable. The grammar is unchanged if not.
+   */
+  bool loadCache(const std::string& path, uint64_t key);
+
+  /**
+   * Writes everything computed from the grammar to a cache file, replacing
+   * it at once so that other processes never read it half written.
+   * @param path File Location of the cache
+   * @param key Hash of the grammar text
+   */
+  void saveCache(const std::string& path, uint64_t key) const;
 
  private:
   // Contains the list of grammar entries. Pair first = Left side of grammar,
@@ -149,10 +306,32 @@ class Grammar {
   // Sets containing the non-terminals and terminals of the grammar.
   std::unordered_set<std::string> nonTerminalsSet;
   std::set<std::string> terminalsSet;
+  std::unordered_set<std::string> groupsSet;  // non-terminals of groups
+  std::vector<Operator> operators;
+
+  // Terminals are numbered in sorted order, which includes $ and λ, and
+  // non-terminals in the order of nonTerminalSetOrder.
+  std::vector<std::string> terminalNames;
+  size_t lambda = 0;
+  size_t end = 0;  // $
+
+  // The grammar entries numbered, and the entries of each non-terminal.
+  std::vector<Production> productions;
+  std::vector<std::vector<size_t>> productionsOf;
+
+  // Nullable non-terminals, and the first and follow members of each
+  // non-terminal. λ is never a member of first, nullable has it instead.
+  Bitset nullable;
+  std::vector<Bitset> firstMembers;
+  std::vector<Bitset> followMembers;
 
-  // First and Follow Members of each non-terminal.
-  std::unordered_map<std::string, std::set<std::string>> firstMembers;
-  std::unordered_map<std::string, std::set<std::string>> followMembers;
+  // The table compileParsingTable returns for AUTO, if it was loaded from
+  // tables.
+  std::shared_ptr<const CompiledTable> cachedTable;
+
+  // Lexical rules are small and quick to compile, so they are compiled again
+  // rather than stored in tables.
+  std::vector<LexicalRule> lexicalRules;
 
   /**
    * Parses the grammar from the text file and initializes grammar elements
@@ -163,4 +342,186 @@ class Grammar {
 
   // process processes the prepared grammar. Call this after prepareGrammar.
   void process();
+
+  // checkOperators throws std::invalid_argument if the grammar entries of an
+  // expression do not match its operators.
+  void checkOperators() const;
+};
+
+// Grammar::CompiledTable is a Predictive Parsing Table for parsers. Its rows
+// are the non-terminals and its columns the terminals of the grammar, and each
+// cell holds the number of the grammar entry to expand, whose right side is
+// stored with all the others as one array of symbols.
+class Grammar::CompiledTable {
+ public:
+  typedef uint16_t Production;
+
+  // ERROR is the production of every empty cell.
+  static constexpr Production ERROR = UINT16_MAX;
+
+  /**
+   * Looks up the grammar entry to expand a non-terminal by.
+   * @param nonTerminal Non-terminal on top of the parse stack
+   * @param terminal Symbol of the next lexeme
+   * @return Production, or ERROR if there is none
+   */
+  Production lookup(Symbols::ID nonTerminal, Symbols::ID terminal) const {
+    if (nonTerminal >= rowOf.size() || terminal >= columnOf.size()) {
+      return ERROR;
+    }
+    const uint32_t row = rowOf[nonTerminal];
+    const uint32_t column = columnOf[terminal];
+    if (row == NONE || column == NONE) {
+      return ERROR;
+    }
+
+    // A dense table has no checks, since every row has a cell in every
+    // column.
+    const size_t cell = offsets[row] + column;
+    if (!checks.empty() && (cell >= checks.size() || checks[cell] != row)) {
+      return ERROR;
+    }
+    return cells[cell];
+  }
+
+  /**
+   * Returns the symbols that a grammar entry expands to, without λ.
+   * @param production Production from lookup
+   */
+  std::span<const Symbols::ID> rightSide(Production production) const {
+    return {symbols.data() + starts[production],
+            symbols.data() + starts[production + 1]};
+  }
+
+  // size returns the number of cells stored.
+  size_t size() const { return cells.size(); }
+
+ private:
+  friend class Grammar;
+
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  // rowOf and columnOf are indexed by symbol.
+  std::vector<uint32_t> rowOf;
+  std::vector<uint32_t> columnOf;
+
+  // The cells of a row start at its offset. When rows overlap, checks holds
+  // the row that each cell belongs to.
+  std::vector<size_t> offsets;
+  std::vector<uint32_t> checks;
+  std::vector<Production> cells;
+
+  // The right side of production p is symbols[starts[p]:starts[p + 1]].
+  std::vector<uint32_t> starts;
+  std::vector<Symbols::ID> symbols;
+};
+
+// Grammar::LexicalRule is a non-terminal that only derives strings of word
+// characters through a regular language, compiled into a DFA over bytes.
+// Parsers match words against it at once instead of expanding the non-terminal
+// a character at a time.
+class Grammar::LexicalRule {
+ public:
+  std::string nonTerminal;
+
+  /**
+   * Returns the length of the longest non-empty prefix of the text that the
+   * non-terminal derives.
+   * @param text Text to match, such as a word
+   * @return Length of the prefix, or 0 if there is none.
+   */
+  size_t match(std::string_view text) const {
+    size_t longest = 0;
+    size_t state = START;
+    for (size_t i = 0; i < text.size(); i++) {
+      state = transitions[state * 256 + static_cast<unsigned char>(text[i])];
+      if (state == DEAD) {
+        break;
+      }
+      if (accepting.test(state)) {
+        longest = i + 1;
+      }
+    }
+    return longest;
+  }
+
+  /**
+   * Checks if the terminal may follow the non-terminal.
+   */
+  bool follows(Symbols::ID terminal) const {
+    return terminal < follow.size() && follow[terminal];
+  }
+
+ private:
+  friend class Grammar;
+
+  // DEAD is the state that no string leads out of, and START is the state
+  // before the first character.
+  static constexpr uint16_t DEAD = 0;
+  static constexpr uint16_t START = 1;
+
+  // MAX_STATES is how many states a DFA may have. Non-terminals whose DFA
+  // would have more are not lexical rules.
+  static constexpr size_t MAX_STATES = 1024;
+
+  std::vector<uint16_t> transitions;  // 256 per state, indexed by byte
+  Bitset accepting;
+  std::vector<bool> follow;  // indexed by symbol
+};
+
+// Grammar::Tables is everything computed from a grammar as flat arrays, which
+// is how grammars are stored in cache files and compiled into programs. It
+// does not own the arrays. Symbols on right sides are numbered with the
+// non-terminals first, followed by the terminals.
+struct Grammar::Tables {
+  std::span<const std::string_view> nonTerminals;  // in declaration order
+  std::span<const std::string_view> terminals;     // sorted, with $ and λ
+  std::span<const uint32_t> grammarTerminals;  // the terminals of the text
+  std::span<const uint32_t> groups;            // the non-terminals of groups
+
+  // The non-terminal, terminal and precedence of each operator in turn, with
+  // the precedence shifted left by one and ORed with 1 if right-associative.
+  std::span<const uint32_t> operators;
+
+  // The left side of each grammar entry, and where its right side starts in
+  // rights, along with where the last one ends. λ is kept in right sides.
+  std::span<const uint32_t> lefts;
+  std::span<const uint32_t> starts;
+  std::span<const uint32_t> rights;
+
+  // The words of the nullable Bitset, and of the first and follow Bitsets of
+  // each non-terminal in turn.
+  std::span<const uint64_t> nullable;
+  std::span<const uint64_t> first;
+  std::span<const uint64_t> follow;
+
+  // The cells of the AUTO layout of the Compiled Parsing Table.
+  std::span<const uint64_t> offsets;
+  std::span<const uint32_t> checks;
+  std::span<const CompiledTable::Production> cells;
+};
+
+// Grammar::OwnedTables holds the arrays of Tables, except for the names, which
+// point into wherever they were loaded from.
+struct Grammar::OwnedTables {
+  std::vector<std::string_view> nonTerminals;
+  std::vector<std::string_view> terminals;
+  std::vector<uint32_t> grammarTerminals;
+  std::vector<uint32_t> groups;
+  std::vector<uint32_t> operators;
+  std::vector<uint32_t> lefts;
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> rights;
+  std::vector<uint64_t> nullable;
+  std::vector<uint64_t> first;
+  std::vector<uint64_t> follow;
+  std::vector<uint64_t> offsets;
+  std::vector<uint32_t> checks;
+  std::vector<CompiledTable::Production> cells;
+
+  Tables view() const {
+    return {nonTerminals, terminals, grammarTerminals, groups,  operators,
+            lefts,        starts,    rights,           nullable, first,
+            follow,       offsets,   checks,           cells};
+  }
 };
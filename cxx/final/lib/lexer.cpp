@@ -1,45 +1,167 @@
 #include "lexer.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
-#include <cctype>
-#include <functional>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <exception>
 #include <iostream>
+#include <iterator>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "scan.hpp"
+
 namespace {
-struct lexingState {
+// charClass is a set of bits describing which classes a byte belongs to. The
+// classes follow the "C" locale's <cctype>, which is what the lexer has
+// always used.
+enum charClass : uint8_t {
+  SPACE = 1 << 0,    // std::isspace
+  ALNUM = 1 << 1,    // std::isalnum
+  WORDISH = 1 << 2,  // std::isalnum or '.', the rest of a word
+  PUNCTISH = 1 << 3, // std::ispunct
+  QUOTE = 1 << 4,    // '"', the end of a string
+  NEWLINE = 1 << 5,  // '\n', the end of a line or comment line
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+  std::array<uint8_t, 256> classes{};
+  for (int c = 0; c < 256; c++) {
+    const bool space = c == ' ' || (c >= '\t' && c <= '\r');
+    const bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                       (c >= 'A' && c <= 'Z');
+    const bool punct = c > ' ' && c < 0x7f && !alnum;
+
+    uint8_t cls = 0;
+    cls |= space ? SPACE : 0;
+    cls |= alnum ? ALNUM | WORDISH : 0;
+    cls |= c == '.' ? WORDISH : 0;
+    cls |= punct ? PUNCTISH : 0;
+    cls |= c == '"' ? QUOTE : 0;
+    cls |= c == '\n' ? NEWLINE : 0;
+    classes[c] = cls;
+  }
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+// is returns true if the given character, which may be EOF, belongs to any of
+// the given classes.
+inline bool is(int c, uint8_t classes) {
+  return c != EOF && (charClasses[c] & classes);
+}
+
+enum lexState : uint8_t {
+  START,
+  LINE,
+  SPACE_RUN,
+  WORD,
+  PUNCT,
+  STRING,
+  COMMENT,
+  INVALID,
+  END,
+};
+
+constexpr std::array<lexState, 256> makeStartStates() {
+  std::array<lexState, 256> states{};
+  for (int c = 0; c < 256; c++) {
+    // Order matters here: it mirrors the order in which the start state used
+    // to try each character class.
+    if (c == '\n') {
+      states[c] = LINE;
+    } else if (c == '"') {
+      states[c] = STRING;
+    } else if (c == '/') {
+      states[c] = COMMENT;  // only if the next character is also '/'
+    } else if (charClasses[c] & ALNUM) {
+      states[c] = WORD;
+    } else if (charClasses[c] & PUNCTISH) {
+      states[c] = PUNCT;
+    } else if (charClasses[c] & SPACE) {
+      states[c] = SPACE_RUN;
+    } else {
+      states[c] = INVALID;
+    }
+  }
+  return states;
+}
+
+// startStates maps the first character of a lexeme to the state that lexes
+// it.
+constexpr std::array<lexState, 256> startStates = makeStartStates();
+
+// streamInput reads characters from an input stream one at a time. It counts
+// the offset itself since tellg() returns -1 once the stream has hit EOF, and
+// keeps the text it has read, which the lexemes of the lines are slices of.
+struct streamInput {
   std::istream& in;
-  std::vector<Lexer::Lexeme> line = {};
-  Lexer::Lines lines = {};
-  int64_t lineStart = 0;
+  std::string text;
 
-  lexingState(std::istream& in_) : in(in_) {}
+  streamInput(std::istream& in_) : in(in_) {}
 
-  int get() { return in.get(); }
-  char getc() { return static_cast<char>(get()); }
+  int get() {
+    const int c = in.get();
+    if (c != EOF) {
+      text += static_cast<char>(c);
+    }
+    return c;
+  }
 
   int peek() { return in.peek(); }
 
-  bool drain(char c) {
-    return drain([c](int x) { return c == x; });
+  int64_t tell() const { return text.size(); }
+
+  void undo(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      in.unget();
+      text.pop_back();
+    }
   }
 
-  bool drain(std::function<bool(int)> f) {
+  // take consumes a single character and returns it as a string.
+  std::string take() { return std::string(1, static_cast<char>(get())); }
+
+  // skip consumes characters while they belong to the given classes.
+  bool skip(uint8_t classes) {
     bool found = false;
-    while (f(peek())) {
+    while (is(peek(), classes)) {
       get();
       found = true;
     }
     return found;
   }
 
-  std::string slurp(std::function<bool(int)> f) {
+  // slurp consumes and returns characters while they belong to the given
+  // classes.
+  std::string slurp(uint8_t classes) {
     std::string s;
-    while (f(peek())) {
+    while (is(peek(), classes)) {
+      s += static_cast<char>(get());
+    }
+    return s;
+  }
+
+  // slurpUntil consumes and returns characters up to the first one that
+  // belongs to the given classes. Hitting EOF first is an error.
+  std::string slurpUntil(uint8_t classes) {
+    std::string s;
+    while (!is(peek(), classes)) {
       const auto c = get();
       if (c == EOF) {
         throw std::runtime_error("unexpected EOF");
@@ -48,13 +170,107 @@ struct lexingState {
     }
     return s;
   }
+};
 
-  void undo(size_t n) {
-    for (size_t i = 0; i < n; i++) {
-      in.unget();
+// bufferInput scans a contiguous buffer with raw pointers. Everything it
+// returns is a view into the buffer. The runs the lexer scans the most are
+// handed to the vectorized kernels in Scan.
+struct bufferInput {
+  const char* begin;
+  const char* p;
+  const char* end;
+
+  bufferInput(std::string_view text, int64_t offset = 0)
+      : begin(text.data()),
+        p(text.data() + offset),
+        end(text.data() + text.size()) {}
+
+  int get() { return p < end ? static_cast<unsigned char>(*p++) : EOF; }
+
+  int peek() const { return p < end ? static_cast<unsigned char>(*p) : EOF; }
+
+  int64_t tell() const { return p - begin; }
+
+  void undo(size_t n) { p -= n; }
+
+  std::string_view take() { return {p++, 1}; }
+
+  bool skip(uint8_t classes) { return !slurp(classes).empty(); }
+
+  std::string_view slurp(uint8_t classes) {
+    const char* start = p;
+    switch (classes) {
+      case WORDISH:
+        p = Scan::word(p, end);
+        break;
+      case SPACE:
+        p = Scan::space(p, end);
+        break;
+      default:
+        while (p < end &&
+               (charClasses[static_cast<unsigned char>(*p)] & classes)) {
+          p++;
+        }
     }
+    return {start, static_cast<size_t>(p - start)};
   }
 
+  std::string_view slurpUntil(uint8_t classes) {
+    const char* start = p;
+    switch (classes) {
+      case QUOTE:
+        p = Scan::find(p, end, '"');
+        break;
+      case NEWLINE:
+        p = Scan::find(p, end, '\n');
+        break;
+      default:
+        while (p < end &&
+               !(charClasses[static_cast<unsigned char>(*p)] & classes)) {
+          p++;
+        }
+    }
+    if (p == end) {
+      throw std::runtime_error("unexpected EOF");
+    }
+    return {start, static_cast<size_t>(p - start)};
+  }
+};
+
+template <class Input>
+struct lexingState {
+  Input in;
+  Lexer::Source& source;
+  bool skipComments;
+  lexState lex = START;
+
+  // emitted is set once a lex function has lexed a lexeme.
+  bool emitted = false;
+  Lexer::Lexeme lexeme;
+
+  // lineOpen is true if a lexeme, skipped comments included, was lexed since
+  // the last line break. Line breaks without one do not end a line.
+  bool lineOpen = false;
+  int64_t lineStart = 0;
+  int64_t firstBreak = -1;  // since the last lexeme returned
+
+  lexingState(Input in_, Lexer::Source& source_, bool skipComments_)
+      : in(in_), source(source_), skipComments(skipComments_) {}
+
+  int get() { return in.get(); }
+
+  int peek() { return in.peek(); }
+
+  int64_t tell() const { return in.tell(); }
+
+  void undo(size_t n) { in.undo(n); }
+
+  // keep returns a view of the given string that lives as long as the source.
+  std::string_view keep(std::string str) {
+    return source.store(std::move(str));
+  }
+  std::string_view keep(std::string_view str) { return str; }
+
   // aheadIs returns true if the next n characters are equal to the given
   // string.
   bool aheadIs(std::string_view s) {
@@ -69,162 +285,810 @@ struct lexingState {
     return true;
   }
 
-  bool isWhitespace() { return isWhitespace(peek()); }
-  bool isWhitespace(int c) { return std::isspace(c) || c == EOF; }
+  void emit(Lexer::Lexeme l) {
+    lexeme = l;
+    emitted = true;
+    lineOpen = true;
+  }
 
-  void flushLine() {
-    if (line.empty()) {
+  void breakLine() {
+    if (!lineOpen) {
       return;
     }
 
-    int64_t end = in.tellg();
-    lines.push_back({lineStart, end, line});
+    lineStart = tell();
+    if (firstBreak == -1) {
+      firstBreak = lineStart;
+    }
+    lineOpen = false;
+  }
+};
+
+std::string_view trimSpace(std::string_view str) {
+  const auto start = str.find_first_not_of(" \t\r\n");
+  if (start == std::string_view::npos) {
+    return {};
+  }
+  return str.substr(start, str.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+// The lex functions below each consume characters from the input and return
+// the next lexing state.
 
-    line.clear();
-    lineStart = end;
+template <class Input>
+lexState lexStart(lexingState<Input>& state) {
+  const int c = state.peek();
+  if (c == EOF) {
+    return END;
   }
+
+  const lexState next = startStates[c];
+  if (next == COMMENT && !state.aheadIs("//")) {
+    return PUNCT;
+  }
+  return next;
+}
+
+template <class Input>
+lexState lexLine(lexingState<Input>& state) {
+  state.in.skip(NEWLINE);
+  state.breakLine();
+  return START;
+}
+
+template <class Input>
+lexState lexSpace(lexingState<Input>& state) {
+  state.in.skip(SPACE);
+  return START;
+}
+
+template <class Input>
+lexState lexWord(lexingState<Input>& state) {
+  int64_t start = state.tell();
+  auto word = state.keep(state.in.slurp(WORDISH));
+  int64_t end = state.tell();
+  state.emit({start, end, Lexer::Lexeme::WORD, word, Symbols::find(word)});
+  return START;
+}
+
+template <class Input>
+lexState lexPunct(lexingState<Input>& state) {
+  int64_t start = state.tell();
+  auto terminator = state.keep(state.in.take());
+  state.emit({start, start + 1, Lexer::Lexeme::PUNCT, terminator,
+              Symbols::find(terminator)});
+  return START;
+}
+
+template <class Input>
+lexState lexString(lexingState<Input>& state) {
+  int64_t start = state.tell();
+  state.get();  // consume the opening quote
+  auto str = state.in.slurpUntil(QUOTE);
+  state.get();  // consume the closing quote
+  int64_t end = state.tell();
+  state.emit({start, end, Lexer::Lexeme::STRING, state.keep(std::move(str))});
+  return START;
+}
+
+template <class Input>
+lexState lexComment(lexingState<Input>& state) {
+  int64_t start = state.tell();
+  std::string comment;
+  while (true) {
+    const auto slurped = state.in.slurpUntil(NEWLINE);
+    const std::string_view line = slurped;
+    if (line.starts_with("//")) {
+      if (!state.skipComments) {
+        comment += trimSpace(line.substr(2));
+      }
+
+      state.get();  // consume the newline
+      continue;
+    }
+
+    // Line does not start with "//", so we check to see if it ends
+    // with "//". If it does, then we're done with comments.
+    if (line.ends_with("//")) {
+      if (!state.skipComments) {
+        comment += trimSpace(line.substr(0, line.size() - 2));
+      }
+
+      state.get();  // consume the newline
+      break;
+    }
+
+    // If it doesn't, then it's actually part of a new statement, so
+    // we must unget the line. Add 1 to undo the newline.
+    state.undo(line.size() + 1);
+    break;
+  }
+
+  // Skipped comments are never returned, so there is no need to store them.
+  int64_t end = state.tell();
+  state.emit({start, end, Lexer::Lexeme::COMMENT,
+              state.skipComments ? "" : state.keep(std::move(comment))});
+  return START;
+}
+
+template <class Input>
+[[noreturn]] void lexInvalid(lexingState<Input>& state) {
+  std::stringstream s;
+  s << "unexpected character: " << state.peek() << " "
+    << "(" << std::string(1, state.peek()) << ")" << std::endl;
+
+  throw std::runtime_error(s.str());
+}
+
+// lexStep runs the lex function of the current state once.
+template <class Input>
+void lexStep(lexingState<Input>& state) {
+  switch (state.lex) {
+    case START:
+      state.lex = lexStart(state);
+      break;
+    case LINE:
+      state.lex = lexLine(state);
+      break;
+    case SPACE_RUN:
+      state.lex = lexSpace(state);
+      break;
+    case WORD:
+      state.lex = lexWord(state);
+      break;
+    case PUNCT:
+      state.lex = lexPunct(state);
+      break;
+    case STRING:
+      state.lex = lexString(state);
+      break;
+    case COMMENT:
+      state.lex = lexComment(state);
+      break;
+    case INVALID:
+      lexInvalid(state);
+    case END:
+      break;
+  }
+}
+
+// lexNext runs the state machine until it has lexed a lexeme that is not
+// skipped and returns it. At the end of the input it returns an EOF lexeme.
+template <class Input>
+Lexer::Lexeme lexNext(lexingState<Input>& state) {
+  state.firstBreak = -1;
+  while (state.lex != END) {
+    lexStep(state);
+    if (state.emitted) {
+      state.emitted = false;
+      if (state.skipComments && state.lexeme.type == Lexer::Lexeme::COMMENT) {
+        continue;
+      }
+      return state.lexeme;
+    }
+  }
+
+  state.breakLine();
+  return Lexer::Lexeme();
+}
+
+// streamLexer lexes an input stream one lexeme at a time, the same way a
+// TokenStream lexes a source.
+struct streamLexer {
+  lexingState<streamInput> state;
+
+  streamLexer(std::istream& in, Lexer::Source& source)
+      : state(streamInput(in), source, false) {}
+
+  Lexer::Lexeme next() { return lexNext(state); }
+  int64_t lineStart() const { return state.lineStart; }
+  int64_t previousLineEnd() const { return state.firstBreak; }
 };
 
-void trimSpace(std::string& str) {
-  str.erase(0, str.find_first_not_of(" \t\r\n"));
-  str.erase(str.find_last_not_of(" \t\r\n") + 1);
+// collectLines groups the lexemes of the given stream into lines.
+template <class Stream>
+Lexer::Lines collectLines(Stream& stream,
+                          std::shared_ptr<Lexer::Source> source) {
+  Lexer::Lines lines(source);
+  std::vector<Lexer::Lexeme> line;
+  int64_t lineStart = 0;
+  while (true) {
+    const auto lexeme = stream.next();
+    if (stream.previousLineEnd() != -1) {
+      if (!line.empty()) {
+        lines.addLine({lineStart, stream.previousLineEnd()}, line);
+        line.clear();
+      }
+      lineStart = stream.lineStart();
+    }
+
+    if (lexeme.isEOF()) {
+      return lines;
+    }
+    line.push_back(lexeme);
+  }
 }
 
-enum lexState {
-  START,
-  LINE,
-  WORD,
-  PUNCT,
-  STRING,
-  COMMENT,
-  END,
+// lexEvent is a lexeme or a line break lexed from a chunk of a source.
+struct lexEvent {
+  int64_t step;           // where the state machine started lexing it
+  Lexer::Lexeme lexeme;   // EOF for line breaks
+  int64_t lineEnd = -1;   // where the line ends, for line breaks
+
+  bool isBreak() const { return lineEnd != -1; }
+};
+
+// nextEvent runs the state machine until it has lexed a lexeme or a line
+// break, the end of the source being the last line break. It returns false
+// instead once it is about to start a lexeme at or after end.
+bool nextEvent(lexingState<bufferInput>& state, int64_t end, lexEvent& event) {
+  while (state.lex != END) {
+    const int64_t step = state.tell();
+    if (state.lex == START && step >= end) {
+      return false;
+    }
+
+    const lexState lex = state.lex;
+    lexStep(state);
+    if (state.emitted) {
+      state.emitted = false;
+      event = {step, state.lexeme};
+      return true;
+    }
+    if (lex == LINE || state.lex == END) {
+      event = {step, Lexer::Lexeme(), state.tell()};
+      return true;
+    }
+  }
+  return false;
+}
+
+// lexChunk is a chunk of a source that starts after a newline, lexed as if it
+// started a lexeme.
+struct lexChunk {
+  int64_t begin = 0;
+  int64_t end = INT64_MAX;  // INT64_MAX for the last chunk
+
+  std::vector<lexEvent> events;
+  int64_t stop = -1;  // where lexing stopped at or after end
+  std::exception_ptr error;
+
+  // relexed holds the events lexed again from where the previous chunk
+  // really stopped, which are followed by events[from:].
+  std::vector<lexEvent> relexed;
+  size_t from = 0;
+
+  void lex(std::string_view text, Lexer::Source& source, bool skipComments) {
+    lexingState<bufferInput> state(bufferInput(text, begin), source,
+                                   skipComments);
+    try {
+      lexEvent event;
+      while (nextEvent(state, end, event)) {
+        events.push_back(event);
+      }
+      stop = state.tell();
+    } catch (...) {
+      error = std::current_exception();
+    }
+  }
+
+  // resync lexes the chunk again from offset at, where the previous chunk
+  // really stopped, until it lexes something at the same offset as the
+  // first lexing did. From there on both are the same, since the state
+  // machine only depends on the offset it starts lexing at.
+  void resync(int64_t at, std::string_view text, Lexer::Source& source,
+              bool skipComments) {
+    if (at == begin) {
+      return;
+    }
+
+    lexingState<bufferInput> state(bufferInput(text, at), source,
+                                   skipComments);
+    lexEvent event;
+    while (nextEvent(state, end, event)) {
+      const auto it = std::lower_bound(
+          events.begin(), events.end(), event.step,
+          [](const lexEvent& e, int64_t step) { return e.step < step; });
+      if (it != events.end() && it->step == event.step) {
+        from = it - events.begin();
+        return;
+      }
+      relexed.push_back(event);
+    }
+
+    // Never caught up, so the whole chunk was lexed again.
+    from = events.size();
+    stop = state.tell();
+    error = nullptr;
+  }
+
+  template <class F>
+  void forEach(F f) const {
+    for (const auto& event : relexed) {
+      f(event);
+    }
+    for (size_t i = from; i < events.size(); i++) {
+      f(events[i]);
+    }
+  }
 };
 
-// lexFunc is a function that consumes characters from the input stream and
-// returns the next lexing state.
-typedef std::function<lexState(lexingState&)> lexFunc;
-
-// lexStateFuncs maps a lexing state to a lexing function.
-static const std::unordered_map<lexState, lexFunc> lexStateFuncs({
-    {START,
-     [](lexingState& state) {
-       if (state.peek() == '\n') {
-         return LINE;
-       }
-
-       if (state.peek() == '"') {
-         return STRING;
-       }
-
-       if (state.aheadIs("//")) {
-         return COMMENT;
-       }
-
-       if (std::isalnum(state.peek())) {
-         return WORD;
-       }
-
-       if (std::ispunct(state.peek())) {
-         return PUNCT;
-       }
-
-       if (state.drain([](int c) { return std::isspace(c); })) {
-         return START;
-       }
-
-       if (state.peek() == EOF) {
-         state.flushLine();
-         return END;
-       }
-
-       std::stringstream s;
-       s << "unexpected character: " << state.peek() << " "
-         << "(" << std::string(1, state.peek()) << ")" << std::endl;
-
-       throw std::runtime_error(s.str());
-     }},
-    {LINE,
-     [](lexingState& state) {
-       state.drain('\n');
-       state.flushLine();
-       return START;
-     }},
-    {WORD,
-     [](lexingState& state) {
-       int64_t start = state.in.tellg();
-       auto word =
-           state.slurp([](char c) { return std::isalnum(c) || c == '.'; });
-
-       int64_t end = state.in.tellg();
-       state.line.push_back(
-           Lexer::Lexeme{start, end, Lexer::Lexeme::WORD, word});
-       return START;
-     }},
-    {PUNCT,
-     [](lexingState& state) {
-       int64_t start = state.in.tellg();
-       char terminator = state.getc();
-       state.line.push_back({start, start + 1, Lexer::Lexeme::PUNCT,
-                             std::string(1, terminator)});
-       return START;
-     }},
-    {STRING,
-     [](lexingState& state) {
-       int64_t start = state.in.tellg();
-       state.get();  // consume the opening quote
-       auto str = state.slurp([](char c) { return c != '"'; });
-       state.get();  // consume the closing quote
-       int64_t end = state.in.tellg();
-       state.line.push_back({start, end, Lexer::Lexeme::STRING, str});
-       return START;
-     }},
-    {COMMENT,
-     [](lexingState& state) {
-       int64_t start = state.in.tellg();
-       std::string comment;
-       while (true) {
-         auto line = state.slurp([](char c) { return c != '\n'; });
-         if (line.starts_with("//")) {
-           line = line.substr(2);
-           trimSpace(line);
-           comment += line;
-
-           state.get();  // consume the newline
-           continue;
-         }
-
-         // Line does not start with "//", so we check to see if it ends
-         // with "//". If it does, then we're done with comments.
-         if (line.ends_with("//")) {
-           line = line.substr(0, line.size() - 2);
-           trimSpace(line);
-           comment += line;
-
-           state.get();  // consume the newline
-           break;
-         }
-
-         // If it doesn't, then it's actually part of a new statement, so
-         // we must unget the line. Add 1 to undo the newline.
-         state.undo(line.size() + 1);
-         break;
-       }
-
-       int64_t end = state.in.tellg();
-       state.line.push_back(
-           Lexer::Lexeme{start, end, Lexer::Lexeme::COMMENT, comment});
-       return START;
-     }},
-});
+// chunkLines holds the lines of a chunk. Since the chunk doesn't know whether
+// the line before it was still open, everything up to its first line break
+// that ends a line is kept apart.
+struct chunkLines {
+  bool any = false;           // lexed anything, skipped comments included
+  int64_t leadingEnd = -1;    // first line break before anything was lexed
+  std::vector<Lexer::Lexeme> head;
+  int64_t headEnd = -1;       // first line break after something was lexed
+  Lexer::Lines lines;
+  std::vector<Lexer::Lexeme> tail;
+  int64_t tailStart = -1;
+  bool tailOpen = false;
+
+  void group(const lexChunk& chunk, bool skipComments) {
+    std::vector<Lexer::Lexeme> line;
+    bool open = false;
+    chunk.forEach([&](const lexEvent& event) {
+      if (!event.isBreak()) {
+        any = true;
+        open = true;
+        if (!skipComments || event.lexeme.type != Lexer::Lexeme::COMMENT) {
+          line.push_back(event.lexeme);
+        }
+        return;
+      }
+
+      if (!any) {
+        if (leadingEnd == -1) {
+          leadingEnd = event.lineEnd;
+        }
+        return;
+      }
+      if (!open) {
+        return;
+      }
+
+      if (headEnd == -1) {
+        headEnd = event.lineEnd;
+        head = std::move(line);
+      } else if (!line.empty()) {
+        lines.addLine({tailStart, event.lineEnd}, line);
+      }
+      line.clear();
+      tailStart = event.lineEnd;
+      open = false;
+    });
+
+    if (headEnd == -1) {
+      head = std::move(line);
+    } else {
+      tail = std::move(line);
+    }
+    tailOpen = open;
+  }
+};
+
+// parallelFor calls f(i) for every i in [0, n) on up to the given number of
+// threads.
+template <class F>
+void parallelFor(size_t n, size_t threads, F f) {
+  std::atomic<size_t> next = 0;
+  const auto work = [&]() {
+    for (size_t i; (i = next++) < n;) {
+      f(i);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < std::min(threads, n); t++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// replaceRange replaces into[from, to) with the given values plus offset.
+template <class T>
+void replaceRange(std::vector<T>& into, size_t from, size_t to,
+                  const std::vector<T>& with, size_t offset = 0) {
+  into.erase(into.begin() + from, into.begin() + to);
+  const auto inserted =
+      into.insert(into.begin() + from, with.begin(), with.end());
+  if constexpr (std::is_arithmetic_v<T>) {
+    for (auto it = inserted; it != inserted + with.size(); it++) {
+      *it += offset;
+    }
+  }
+}
+
+// replaceIndices replaces the sorted indices in [from, to) with the given
+// ones plus from and shifts the indices after them. It returns the positions
+// of the indices that were replaced.
+std::pair<size_t, size_t> replaceIndices(std::vector<uint32_t>& indices,
+                                         size_t from, size_t to, int64_t shift,
+                                         const std::vector<uint32_t>& with) {
+  const size_t begin =
+      std::lower_bound(indices.begin(), indices.end(), from) - indices.begin();
+  const size_t end =
+      std::lower_bound(indices.begin(), indices.end(), to) - indices.begin();
+  for (size_t i = end; i < indices.size(); i++) {
+    indices[i] += shift;
+  }
+  replaceRange(indices, begin, end, with, from);
+  return {begin, end};
+}
+
+// minChunkSize keeps chunks large enough to be worth a thread.
+constexpr size_t minChunkSize = 64 << 10;
 }  // namespace
 
+bool Lexer::isWordCharacter(char c) {
+  return charClasses[static_cast<unsigned char>(c)] & WORDISH;
+}
+
 Lexer::Lines Lexer::lex(std::istream& in) {
-  lexingState lexing(in);
-  lexState lex = START;
-  while (lex != END) {
-    lex = lexStateFuncs.at(lex)(lexing);
+  // Lexemes read from a stream are not slices of any buffer, so they are
+  // stored in a scratch source until the text that was read replaces it.
+  auto scratch = Source::borrow("");
+  streamLexer stream(in, *scratch);
+  auto lines = collectLines(stream, scratch);
+
+  auto& store = *lines.store;
+  store.source = Source::own(std::move(stream.state.in.text));
+  for (auto& value : store.commentValues) {
+    value = store.source->store(std::string(value));
+  }
+  lines.shrinkToFit();
+  return lines;
+}
+
+Lexer::Lines Lexer::lex(std::shared_ptr<Source> source) {
+  TokenStream stream(source);
+  return lex(stream);
+}
+
+Lexer::Lines Lexer::lex(TokenStream& stream) {
+  auto lines = collectLines(stream, stream.source());
+  lines.shrinkToFit();
+  return lines;
+}
+
+struct Lexer::TokenStream::State : lexingState<bufferInput> {
+  using lexingState::lexingState;
+};
+
+Lexer::TokenStream::TokenStream(std::shared_ptr<Source> source,
+                                Comments comments)
+    : src(source),
+      state(std::make_unique<State>(bufferInput(source->text()), *source,
+                                    comments == SKIP_COMMENTS)) {}
+
+Lexer::TokenStream::TokenStream(TokenStream&&) noexcept = default;
+
+Lexer::TokenStream::~TokenStream() = default;
+
+Lexer::Lexeme Lexer::TokenStream::next() { return lexNext(*state); }
+
+int64_t Lexer::TokenStream::lineStart() const { return state->lineStart; }
+
+int64_t Lexer::TokenStream::previousLineEnd() const {
+  return state->firstBreak;
+}
+
+Lexer::Lines Lexer::lexParallel(std::shared_ptr<Source> source,
+                               size_t threads, Comments comments) {
+  const auto text = source->text();
+  const bool skipComments = comments == SKIP_COMMENTS;
+
+  const size_t count = std::min(threads, text.size() / minChunkSize);
+  if (count <= 1) {
+    TokenStream stream(source, comments);
+    return lex(stream);
+  }
+
+  // Split the text into chunks that start right after a newline.
+  std::vector<lexChunk> chunks;
+  const int64_t size = text.size();
+  for (int64_t begin = 0; begin < size;) {
+    int64_t end = size;
+    if (chunks.size() + 1 < count) {
+      const auto target = text.data() + size * (chunks.size() + 1) / count;
+      const auto newline = Scan::find(std::max(target, text.data() + begin),
+                                      text.data() + size, '\n');
+      end = std::min<int64_t>(newline - text.data() + 1, size);
+    }
+    auto& chunk = chunks.emplace_back();
+    chunk.begin = begin;
+    chunk.end = end == size ? INT64_MAX : end;
+    begin = end;
+  }
+
+  parallelFor(chunks.size(), threads, [&](size_t i) {
+    chunks[i].lex(text, *source, skipComments);
+  });
+
+  // Each chunk was lexed as if the one before it stopped right at its start.
+  // Where it didn't, lex the chunk again until both agree.
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (i > 0) {
+      chunks[i].resync(chunks[i - 1].stop, text, *source, skipComments);
+    }
+    if (chunks[i].error) {
+      std::rethrow_exception(chunks[i].error);
+    }
+  }
+
+  std::vector<chunkLines> grouped(chunks.size());
+  parallelFor(chunks.size(), threads, [&](size_t i) {
+    grouped[i].group(chunks[i], skipComments);
+  });
+
+  // Stitch the lines of each chunk together the way collectLines would.
+  Lines lines(source);
+  std::vector<Lexeme> line;
+  int64_t lineStart = 0;
+  bool open = false;
+
+  const auto endLine = [&](int64_t end) {
+    if (!line.empty()) {
+      lines.addLine({lineStart, end}, line);
+      line.clear();
+    }
+    lineStart = end;
+    open = false;
+  };
+
+  for (auto& chunk : grouped) {
+    if (chunk.leadingEnd != -1 && open) {
+      endLine(chunk.leadingEnd);
+    }
+    if (!chunk.any) {
+      continue;
+    }
+
+    line.insert(line.end(), chunk.head.begin(), chunk.head.end());
+    open = true;
+    if (chunk.headEnd == -1) {
+      continue;
+    }
+
+    endLine(chunk.headEnd);
+    lines.append(chunk.lines);
+    line = std::move(chunk.tail);
+    lineStart = chunk.tailStart;
+    open = chunk.tailOpen;
+  }
+
+  lines.shrinkToFit();
+  return lines;
+}
+
+void Lexer::relex(Lines& lines, Location edit, std::string_view text,
+                  Comments comments) {
+  if (!lines.source()) {
+    throw std::invalid_argument("relex: lines have no source");
+  }
+
+  const auto oldText = lines.source()->text();
+  if (edit.start < 0 || edit.start > edit.end ||
+      edit.end > static_cast<int64_t>(oldText.size())) {
+    throw std::out_of_range("relex: edit is out of range");
+  }
+
+  std::string newText;
+  newText.reserve(oldText.size() - edit.length() + text.size());
+  newText.append(oldText.substr(0, edit.start));
+  newText.append(text);
+  newText.append(oldText.substr(edit.end));
+  auto source = Source::own(std::move(newText));
+  if (source->text().size() > UINT32_MAX) {
+    throw std::length_error("Lines: offsets do not fit in 32 bits");
+  }
+
+  const int64_t shift = text.size() - edit.length();
+  const int64_t editEnd = edit.start + text.size();
+  const bool skipComments = comments == SKIP_COMMENTS;
+
+  // This works on every line in the store, including the ones that lines
+  // might leave out.
+  const Store& old = *lines.store;
+  const size_t count = old.lineStarts.size();
+
+  // Start over at a line before the edit. Since lexing a comment looks at the
+  // whole line of text after it to see if the comment goes on, that line must
+  // also end before the edit.
+  size_t first = std::lower_bound(old.lineStarts.begin(), old.lineStarts.end(),
+                                  edit.start) -
+                 old.lineStarts.begin();
+  int64_t restart = 0;
+  while (first > 0) {
+    first--;
+    const auto newline = oldText.find('\n', old.lineStarts[first]);
+    if (newline < static_cast<size_t>(edit.start)) {
+      restart = old.lineStarts[first];
+      break;
+    }
+  }
+
+  // Lex the new text until a line starts after the edit where an old line
+  // started. The state machine is at the start of a line in both cases, so
+  // the rest of the old lines would be lexed the same again.
+  Lines fresh(source);
+  std::vector<Lexeme> line;
+  int64_t lineStart = restart;
+  bool open = false;
+  size_t last = first;
+
+  lexingState<bufferInput> state(bufferInput(source->text(), restart), *source,
+                                 skipComments);
+  lexEvent event;
+  while (nextEvent(state, INT64_MAX, event)) {
+    if (!event.isBreak()) {
+      open = true;
+      if (!skipComments || event.lexeme.type != Lexeme::COMMENT) {
+        line.push_back(event.lexeme);
+      }
+      continue;
+    }
+    if (!open) {
+      continue;
+    }
+
+    if (!line.empty()) {
+      fresh.addLine({lineStart, event.lineEnd}, line);
+      line.clear();
+    }
+    lineStart = event.lineEnd;
+    open = false;
+
+    if (lineStart < editEnd) {
+      continue;
+    }
+    last = std::lower_bound(old.lineStarts.begin() + last,
+                            old.lineStarts.end(), lineStart - shift) -
+           old.lineStarts.begin();
+    if (last < count && old.lineStarts[last] == lineStart - shift) {
+      break;
+    }
+  }
+  if (state.lex == END) {
+    last = count;
+  }
+
+  // Splice the fresh lines in place of lines [first, last) and shift the ones
+  // after them.
+  Store& store = lines.mutableStore();
+  const Store& added = *fresh.store;
+  const size_t lexemeFirst = store.firsts[first];
+  const size_t lexemeLast = store.firsts[last];
+  const int64_t lexemeShift =
+      static_cast<int64_t>(added.starts.size()) - (lexemeLast - lexemeFirst);
+  const int64_t lineShift =
+      static_cast<int64_t>(added.lineStarts.size()) - (last - first);
+
+  for (size_t i = lexemeLast; i < store.starts.size(); i++) {
+    store.starts[i] += shift;
+  }
+  for (size_t i = last; i < count; i++) {
+    store.lineStarts[i] += shift;
+    store.lineEnds[i] += shift;
+  }
+  for (size_t i = last; i <= count; i++) {
+    store.firsts[i] += lexemeShift;
+  }
+
+  replaceRange(store.starts, lexemeFirst, lexemeLast, added.starts);
+  replaceRange(store.lengths, lexemeFirst, lexemeLast, added.lengths);
+  replaceRange(store.types, lexemeFirst, lexemeLast, added.types);
+  replaceRange(store.symbols, lexemeFirst, lexemeLast, added.symbols);
+  replaceRange(store.lineStarts, first, last, added.lineStarts);
+  replaceRange(store.lineEnds, first, last, added.lineEnds);
+  replaceRange(store.firsts, first, last,
+               std::vector(added.firsts.begin(), added.firsts.end() - 1),
+               lexemeFirst);
+
+  // Comments and comment lines are sparse, so they are found by value.
+  const auto [commentBegin, commentEnd] = replaceIndices(
+      store.comments, lexemeFirst, lexemeLast, lexemeShift, added.comments);
+  replaceRange(store.commentValues, commentBegin, commentEnd,
+               added.commentValues);
+  replaceIndices(store.commentLines, first, last, lineShift,
+                 added.commentLines);
+
+  // The values of the comments that are kept point into the old source.
+  for (size_t i = 0; i < store.commentValues.size(); i++) {
+    if (i < commentBegin || i >= commentBegin + added.comments.size()) {
+      auto& value = store.commentValues[i];
+      value = source->store(std::string(value));
+    }
   }
-  return lexing.lines;
+  store.source = source;
+}
+
+std::shared_ptr<Lexer::Source> Lexer::Source::map(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::system_error(errno, std::generic_category(),
+                            "cannot open " + path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) == -1) {
+    const int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(),
+                            "cannot stat " + path);
+  }
+
+  std::shared_ptr<Source> source(new Source());
+  if (st.st_size > 0) {
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      const int err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(),
+                              "cannot mmap " + path);
+    }
+    source->data = static_cast<const char*>(data);
+    source->size = st.st_size;
+    source->mapped = true;
+  }
+
+  ::close(fd);
+  return source;
+}
+
+std::shared_ptr<Lexer::Source> Lexer::Source::read(std::istream& in) {
+  std::shared_ptr<Source> source(new Source());
+  source->buffer.assign(std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>());
+  source->data = source->buffer.data();
+  source->size = source->buffer.size();
+  return source;
+}
+
+std::shared_ptr<Lexer::Source> Lexer::Source::own(std::string text) {
+  std::shared_ptr<Source> source(new Source());
+  source->buffer = std::move(text);
+  source->data = source->buffer.data();
+  source->size = source->buffer.size();
+  return source;
+}
+
+std::shared_ptr<Lexer::Source> Lexer::Source::borrow(std::string_view text) {
+  std::shared_ptr<Source> source(new Source());
+  source->data = text.data();
+  source->size = text.size();
+  return source;
+}
+
+Lexer::Source::~Source() {
+  if (mapped) {
+    ::munmap(const_cast<char*>(data), size);
+  }
+}
+
+std::string_view Lexer::Source::store(std::string str) {
+  std::lock_guard lock(storing);
+  return stored.emplace_back(std::move(str));
+}
+
+int64_t Lexer::Source::lineStart(int64_t offset) const {
+  std::call_once(indexing, [this]() {
+    lineStarts.push_back(0);
+    const char* end = data + size;
+    for (const char* p = Scan::find(data, end, '\n'); p != end;
+         p = Scan::find(p + 1, end, '\n')) {
+      lineStarts.push_back(p - data + 1);
+    }
+  });
+
+  const auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(),
+                                     std::max<int64_t>(offset, 0));
+  return *(next - 1);
 }
 
 int Lexer::Location::length() const { return end - start; }
@@ -256,8 +1120,10 @@ bool Lexer::Lexeme::includes(const Lexeme& other) const {
 }
 
 Lexer::Lexeme Lexer::Lexeme::slice(int64_t start, int64_t end) const {
-  return Lexeme(loc.start + start, loc.start + end, type,
-                value.substr(start, end - start));
+  const auto sliced = value.substr(start, end - start);
+  return Lexeme(loc.start + start, loc.start + end, type, sliced,
+                type == WORD || type == PUNCT ? Symbols::find(sliced)
+                                              : Symbols::NONE);
 }
 
 std::vector<Lexer::Lexeme> Lexer::Lexeme::separate() const {
@@ -283,6 +1149,80 @@ void Lexer::Lexeme::print(std::ostream& out) const {
   }
 }
 
+Lexer::Lexeme Lexer::Store::lexeme(size_t i) const {
+  const int64_t start = starts[i];
+  const int64_t end = start + lengths[i];
+  const auto type = static_cast<Lexeme::Type>(types[i]);
+  switch (type) {
+    case Lexeme::STRING:
+      return {start, end, type,
+              source->text().substr(start + 1, end - start - 2)};
+    case Lexeme::COMMENT: {
+      const auto comment =
+          std::lower_bound(comments.begin(), comments.end(), i);
+      return {start, end, type, commentValues[comment - comments.begin()]};
+    }
+    default:
+      return {start, end, type, source->text().substr(start, end - start),
+              symbols[i]};
+  }
+}
+
+namespace {
+// countIn returns the number of the given sorted indices in [first, last).
+size_t countIn(const std::vector<uint32_t>& indices, size_t first,
+               size_t last) {
+  return std::lower_bound(indices.begin(), indices.end(), last) -
+         std::lower_bound(indices.begin(), indices.end(), first);
+}
+
+// nthOutside returns the n-th index from first on that is not one of the
+// given sorted indices. Each pass adds the indices skipped so far, which
+// settles after a pass or two since they are sparse.
+size_t nthOutside(const std::vector<uint32_t>& indices, size_t first,
+                  size_t n) {
+  const auto from = std::lower_bound(indices.begin(), indices.end(), first);
+  size_t skipped = 0;
+  while (true) {
+    const size_t i = first + n + skipped;
+    const size_t upTo = std::upper_bound(from, indices.end(), i) - from;
+    if (upTo == skipped) {
+      return i;
+    }
+    skipped = upTo;
+  }
+}
+
+// firstEndingAfter returns the first index in [first, last) whose end(i) is
+// at least at, given that they are sorted by it.
+template <class End>
+size_t firstEndingAfter(size_t first, size_t last, int64_t at, End end) {
+  while (first < last) {
+    const size_t mid = first + (last - first) / 2;
+    if (end(mid) < at) {
+      first = mid + 1;
+    } else {
+      last = mid;
+    }
+  }
+  return first;
+}
+}  // namespace
+
+size_t Lexer::Lexemes::size() const {
+  if (comments) {
+    return last - first;
+  }
+  return last - first - countIn(store->comments, first, last);
+}
+
+Lexer::Lexeme Lexer::Lexemes::operator[](size_t i) const {
+  if (comments) {
+    return store->lexeme(first + i);
+  }
+  return store->lexeme(nthOutside(store->comments, first, i));
+}
+
 Lexer::Location Lexer::Line::relativeLocation(const Location& loc) const {
   int col = 0;
   for (const auto& t : *this) {
@@ -305,10 +1245,129 @@ void Lexer::Line::print(std::ostream& out) const {
   }
 }
 
+Lexer::Lines::Lines(std::shared_ptr<Source> source)
+    : store(std::make_shared<Store>()) {
+  store->source = source;
+}
+
+size_t Lexer::Lines::size() const {
+  const size_t count = store->lineStarts.size();
+  return comments ? count : count - store->commentLines.size();
+}
+
+size_t Lexer::Lines::line(size_t i) const {
+  return comments ? i : nthOutside(store->commentLines, 0, i);
+}
+
+Lexer::Line Lexer::Lines::operator[](size_t i) const {
+  const size_t l = line(i);
+  return Line(Lexemes(store, store->firsts[l], store->firsts[l + 1], comments),
+              {store->lineStarts[l], store->lineEnds[l]});
+}
+
+Lexer::Line Lexer::Lines::at(size_t i) const {
+  if (i >= size()) {
+    throw std::out_of_range("Lines::at: line out of range");
+  }
+  return (*this)[i];
+}
+
+void Lexer::Lines::addLine(Location loc, const std::vector<Lexeme>& lexemes) {
+  if (loc.start < 0 || loc.end > UINT32_MAX) {
+    throw std::length_error("Lines: offsets do not fit in 32 bits");
+  }
+
+  auto& s = mutableStore();
+  bool onlyComments = !lexemes.empty();
+  for (const auto& lexeme : lexemes) {
+    if (lexeme.loc.start < 0 || lexeme.loc.end > UINT32_MAX) {
+      throw std::length_error("Lines: offsets do not fit in 32 bits");
+    }
+    if (lexeme.type == Lexeme::COMMENT) {
+      s.comments.push_back(s.starts.size());
+      s.commentValues.push_back(lexeme.value);
+    } else {
+      onlyComments = false;
+    }
+    s.starts.push_back(lexeme.loc.start);
+    s.lengths.push_back(lexeme.loc.length());
+    s.types.push_back(lexeme.type);
+    s.symbols.push_back(lexeme.symbol);
+  }
+
+  if (onlyComments) {
+    s.commentLines.push_back(s.lineStarts.size());
+  }
+  s.lineStarts.push_back(loc.start);
+  s.lineEnds.push_back(loc.end);
+  s.firsts.push_back(s.starts.size());
+}
+
+Lexer::Store& Lexer::Lines::mutableStore() {
+  if (store.use_count() > 1) {
+    store = std::make_shared<Store>(*store);
+  }
+  return *store;
+}
+
+void Lexer::Lines::append(const Lines& other) {
+  auto& s = mutableStore();
+  const auto& o = *other.store;
+  const uint32_t lexemes = s.starts.size();
+  const uint32_t lines = s.lineStarts.size();
+  s.interned = std::min(s.interned, o.interned);
+
+  s.starts.insert(s.starts.end(), o.starts.begin(), o.starts.end());
+  s.lengths.insert(s.lengths.end(), o.lengths.begin(), o.lengths.end());
+  s.types.insert(s.types.end(), o.types.begin(), o.types.end());
+  s.symbols.insert(s.symbols.end(), o.symbols.begin(), o.symbols.end());
+  for (const auto i : o.comments) {
+    s.comments.push_back(lexemes + i);
+  }
+  s.commentValues.insert(s.commentValues.end(), o.commentValues.begin(),
+                         o.commentValues.end());
+
+  s.lineStarts.insert(s.lineStarts.end(), o.lineStarts.begin(),
+                      o.lineStarts.end());
+  s.lineEnds.insert(s.lineEnds.end(), o.lineEnds.begin(), o.lineEnds.end());
+  for (size_t i = 1; i < o.firsts.size(); i++) {
+    s.firsts.push_back(lexemes + o.firsts[i]);
+  }
+  for (const auto i : o.commentLines) {
+    s.commentLines.push_back(lines + i);
+  }
+}
+
+void Lexer::Lines::shrinkToFit() {
+  auto& s = mutableStore();
+  s.starts.shrink_to_fit();
+  s.lengths.shrink_to_fit();
+  s.types.shrink_to_fit();
+  s.symbols.shrink_to_fit();
+  s.comments.shrink_to_fit();
+  s.commentValues.shrink_to_fit();
+  s.lineStarts.shrink_to_fit();
+  s.lineEnds.shrink_to_fit();
+  s.firsts.shrink_to_fit();
+  s.commentLines.shrink_to_fit();
+}
+
 size_t Lexer::Lines::containingLine(const Lexer::Location& loc) const {
-  for (size_t i = 0; i < size(); i++) {
-    if (at(i).loc.includes(loc)) {
-      return i;
+  // Lines are sorted and only ever share their ends, so the first one that
+  // ends at or after loc is usually the only candidate.
+  const auto& s = *store;
+  const size_t count = s.lineStarts.size();
+  size_t l = firstEndingAfter(0, count, loc.end,
+                              [&](size_t i) { return s.lineEnds[i]; });
+  for (; l < count && s.lineStarts[l] <= loc.start; l++) {
+    if (loc.end > s.lineEnds[l]) {
+      continue;
+    }
+    if (comments) {
+      return l;
+    }
+    if (!std::binary_search(s.commentLines.begin(), s.commentLines.end(), l)) {
+      return l - countIn(s.commentLines, 0, l);
     }
   }
   return -1;
@@ -316,46 +1375,56 @@ size_t Lexer::Lines::containingLine(const Lexer::Location& loc) const {
 
 Lexer::Lexeme Lexer::Lines::findCompleteLexeme(
     const Lexer::Lexeme lexeme) const {
-  for (const auto& line : *this) {
-    for (const auto& token : line) {
-      if (token.includes(lexeme)) {
-        return token;
+  const auto& s = *store;
+  const auto& loc = lexeme.loc;
+  const size_t l = containingLine(loc);
+  if (l == static_cast<size_t>(-1) || loc.start < 0) {
+    return lexeme;
+  }
+
+  // Lexemes within a line are sorted the same way lines are.
+  for (size_t stored = line(l);
+       stored < s.lineStarts.size() && s.lineStarts[stored] <= loc.start;
+       stored++) {
+    const size_t last = s.firsts[stored + 1];
+    size_t i = firstEndingAfter(s.firsts[stored], last, loc.end, [&](size_t i) {
+      return int64_t(s.starts[i]) + s.lengths[i];
+    });
+    for (; i < last && s.starts[i] <= loc.start; i++) {
+      if (!comments && s.types[i] == Lexeme::COMMENT) {
+        continue;
+      }
+      if (loc.end <= int64_t(s.starts[i]) + s.lengths[i]) {
+        return s.lexeme(i);
       }
     }
   }
   return lexeme;
 }
 
-Lexer::Lines Lexer::Lines::removeComments() const {
-  Lexer::Lines result;
-  result.reserve(size());
-
-  for (const auto& line : *this) {
-    std::vector<Lexer::Lexeme> tokens;
-    tokens.reserve(line.size());
-    std::copy_if(line.begin(), line.end(), std::back_inserter(tokens),
-                 [](const Lexer::Lexeme& t) {
-                   return t.type != Lexer::Lexeme::COMMENT;
-                 });
-    if (!tokens.empty()) {
-      result.push_back({line.loc, tokens});
-    }
+Lexer::Location Lexer::Lines::relativeLocation(const Location& loc) const {
+  const auto& source = store->source;
+  if (!source || loc.start < 0 ||
+      loc.end > static_cast<int64_t>(source->text().size())) {
+    return {-1, -1};
   }
+  const int64_t start = source->lineStart(loc.start);
+  return {loc.start - start, loc.end - start};
+}
 
-  return result;
+Lexer::Lines Lexer::Lines::removeComments() const {
+  Lines view(*this);
+  view.comments = false;
+  return view;
 }
 
-std::vector<Lexer::Lexeme> Lexer::Lines::flatten() const {
-  std::vector<Lexer::Lexeme> result;
-  for (const auto& line : *this) {
-    std::copy(line.begin(), line.end(), std::back_inserter(result));
-  }
-  return result;
+Lexer::Lexemes Lexer::Lines::flatten() const {
+  return Lexemes(store, 0, store->starts.size(), comments);
 }
 
 void Lexer::Lines::print(std::ostream& out) const {
   for (size_t i = 0; i < size(); i++) {
-    out << at(i);
+    out << (*this)[i];
     if (i < size() - 1) {
       out << "\n";
     }
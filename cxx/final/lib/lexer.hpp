@@ -1,19 +1,146 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <iomanip>
 #include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "symbols.hpp"
+
 // Lexer defines a lexer, which parses an input stream into a list of lexemes.
 struct Lexer {
   struct Location;
   struct Lexeme;
   struct Line;
   struct Lines;
+  struct Store;
+  class Lexemes;
+  class Source;
+  class TokenStream;
+
+  enum Comments {
+    KEEP_COMMENTS,
+    SKIP_COMMENTS,
+  };
 
+  // lex reads the input stream one character at a time.
   static Lines lex(std::istream& in);
+
+  // lex scans the contiguous bytes of the given source. The returned lexemes
+  // point into the source, which the returned lines keep alive.
+  static Lines lex(std::shared_ptr<Source> source);
+
+  // lex collects the rest of the given stream into lines.
+  static Lines lex(TokenStream& stream);
+
+  // lexParallel lexes the source on the given number of threads and returns
+  // the same lines as lex(source) would, without comments if they are
+  // skipped. The source is split into chunks at line boundaries, each chunk
+  // is lexed as if it started a lexeme, and chunks whose start turns out to
+  // be inside a string or comment are lexed again from where the previous
+  // chunk really ended.
+  static Lines lexParallel(std::shared_ptr<Source> source, size_t threads,
+                           Comments comments = KEEP_COMMENTS);
+
+  // relex replaces the bytes of the source of the given lines within edit with
+  // text and updates the lines to match, as if the new source was lexed with
+  // the given comment mode. Only the lines from the one before the edit up to
+  // the first line after it that starts the same as before are lexed again,
+  // which includes lines pulled into or out of a multi-line comment. The
+  // locations of the lines after that are shifted in place. The lines must
+  // have been lexed from their source. If lexing fails, the lines are left
+  // untouched.
+  static void relex(Lines& lines, Location edit, std::string_view text,
+                    Comments comments = KEEP_COMMENTS);
+
+  // isWordCharacter returns true if the given character can be part of a
+  // word: letters, digits and '.'.
+  static bool isWordCharacter(char c);
+};
+
+// Source owns the bytes that lexemes point into. It is either a read-only
+// memory mapping of a file, a copy of some input or a borrowed buffer.
+class Lexer::Source {
+ public:
+  // map memory-maps the file at the given path. It throws a std::system_error
+  // if the file cannot be opened.
+  static std::shared_ptr<Source> map(const std::string& path);
+
+  // read reads the entire input stream into memory.
+  static std::shared_ptr<Source> read(std::istream& in);
+
+  // borrow wraps the given buffer without copying it. The caller must keep the
+  // buffer alive for as long as the source and its lexemes are used.
+  static std::shared_ptr<Source> borrow(std::string_view text);
+
+  // own takes ownership of the given text.
+  static std::shared_ptr<Source> own(std::string text);
+
+  Source(const Source&) = delete;
+  Source& operator=(const Source&) = delete;
+  ~Source();
+
+  std::string_view text() const { return {data, size}; }
+
+  // store keeps the given string alive for as long as the source and returns
+  // a view of it. It is used for lexemes that are not a slice of the text. It
+  // is safe to call from multiple threads.
+  std::string_view store(std::string str);
+
+  // lineStart returns the offset at which the line of text containing the
+  // given offset starts. The first call indexes the start of every line, so
+  // that later calls are a binary search.
+  int64_t lineStart(int64_t offset) const;
+
+ private:
+  const char* data = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+
+  std::string buffer;
+  std::deque<std::string> stored;
+  std::mutex storing;
+
+  mutable std::vector<int64_t> lineStarts;
+  mutable std::once_flag indexing;
+
+  Source() = default;
+};
+
+// TokenStream lexes a source on demand, one lexeme per call to next(), so that
+// only the lexeme being looked at has to be kept in memory.
+class Lexer::TokenStream {
+ public:
+  TokenStream(std::shared_ptr<Source> source,
+              Comments comments = KEEP_COMMENTS);
+  TokenStream(TokenStream&&) noexcept;
+  ~TokenStream();
+
+  // next lexes and returns the next lexeme. Once the source is exhausted, it
+  // returns an EOF lexeme.
+  Lexeme next();
+
+  // lineStart returns the offset at which the line of the lexeme last
+  // returned by next() starts.
+  int64_t lineStart() const;
+
+  // previousLineEnd returns the offset at which the line of the lexeme
+  // returned before that ended, or -1 if both are on the same line.
+  int64_t previousLineEnd() const;
+
+  const std::shared_ptr<Source>& source() const { return src; }
+
+ private:
+  struct State;
+
+  std::shared_ptr<Source> src;
+  std::unique_ptr<State> state;
 };
 
 struct Lexer::Location {
@@ -43,15 +170,21 @@ struct Lexer::Lexeme {
 
   Location loc;
   Type type;
-  std::string value;
+  std::string_view value;  // owned by the Source of the Lines
+
+  // symbol is the grammar symbol that the value of a word or punctuation was
+  // interned as when it was lexed, or NONE.
+  Symbols::ID symbol = Symbols::NONE;
 
   Lexeme() : type(WORD), value("") {}  // EOF token
 
-  Lexeme(int64_t start, int64_t end, Type type, std::string value)
-      : loc{start, end}, type(type), value(value) {}
+  Lexeme(int64_t start, int64_t end, Type type, std::string_view value,
+         Symbols::ID symbol = Symbols::NONE)
+      : loc{start, end}, type(type), value(value), symbol(symbol) {}
 
-  Lexeme(Location loc, Type type, std::string value)
-      : loc(loc), type(type), value(value) {}
+  Lexeme(Location loc, Type type, std::string_view value,
+         Symbols::ID symbol = Symbols::NONE)
+      : loc(loc), type(type), value(value), symbol(symbol) {}
 
   bool isEOF() const;
   bool includes(const Lexeme& other) const;
@@ -75,14 +208,113 @@ struct Lexer::Lexeme {
   void print(std::ostream& out) const;
 };
 
-struct Lexer::Line : std::vector<Lexeme> {
-  Location loc;
+// Store keeps the lexemes of some lines in parallel arrays of 32-bit offsets
+// into the source. The values of words, punctuation and strings are slices of
+// the source text, so only the values of comments are kept.
+struct Lexer::Store {
+  std::shared_ptr<Source> source;
+
+  // interned is the number of symbols that were interned when the lexemes were
+  // lexed, which are the only ones they can be tagged with.
+  size_t interned = Symbols::size();
+
+  // One entry per lexeme.
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> lengths;
+  std::vector<uint8_t> types;
+  std::vector<Symbols::ID> symbols;
+
+  // comments holds the index of every comment in order, and commentValues
+  // their values.
+  std::vector<uint32_t> comments;
+  std::vector<std::string_view> commentValues;
+
+  // One entry per line.
+  std::vector<uint32_t> lineStarts;
+  std::vector<uint32_t> lineEnds;
+  std::vector<uint32_t> firsts = {0};  // first lexeme, plus one past the end
+  std::vector<uint32_t> commentLines;  // lines that only have comments
+
+  // lexeme decodes the lexeme at the given index.
+  Lexeme lexeme(size_t i) const;
+};
+
+// Lexemes is a view of a run of lexemes in a Store, optionally without
+// comments. Lexemes are decoded as they are read, so they are returned by
+// value.
+class Lexer::Lexemes {
+ public:
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Lexeme;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Lexeme;
+
+    iterator() = default;
 
-  Line(int64_t start, int64_t end, std::vector<Lexeme> tokens)
-      : std::vector<Lexeme>(tokens), loc({start, end}) {}
+    Lexeme operator*() const { return store->lexeme(i); }
 
-  Line(Location loc, std::vector<Lexeme> tokens)
-      : std::vector<Lexeme>(tokens), loc(loc) {}
+    iterator& operator++() {
+      i++;
+      skip();
+      return *this;
+    }
+
+    iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const iterator& other) const { return i == other.i; }
+
+   private:
+    friend class Lexemes;
+
+    const Store* store = nullptr;
+    size_t i = 0;
+    size_t last = 0;
+    bool comments = true;
+
+    iterator(const Store* store, size_t i, size_t last, bool comments)
+        : store(store), i(i), last(last), comments(comments) {
+      skip();
+    }
+
+    void skip() {
+      while (!comments && i < last && store->types[i] == Lexeme::COMMENT) {
+        i++;
+      }
+    }
+  };
+
+  Lexemes() = default;
+
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+  Lexeme operator[](size_t i) const;
+
+  iterator begin() const { return {store.get(), first, last, comments}; }
+  iterator end() const { return {store.get(), last, last, true}; }
+
+ private:
+  friend struct Line;
+  friend struct Lines;
+
+  std::shared_ptr<const Store> store;
+  size_t first = 0;
+  size_t last = 0;
+  bool comments = true;
+
+  Lexemes(std::shared_ptr<const Store> store, size_t first, size_t last,
+          bool comments)
+      : store(store), first(first), last(last), comments(comments) {}
+};
+
+struct Lexer::Line : Lexemes {
+  Location loc;
 
   friend std::ostream& operator<<(std::ostream& out, const Line& line) {
     line.print(out);
@@ -90,16 +322,73 @@ struct Lexer::Line : std::vector<Lexeme> {
   };
 
   // relativeLocation returns the location of the given token relative to the
-  // start of the line. If the token is not found, it returns {-1, -1}.
+  // start of the line as it is printed. If the token is not found, it returns
+  // {-1, -1}.
   Location relativeLocation(const Location& loc) const;
 
  private:
+  friend struct Lines;
+
+  Line(Lexemes lexemes, Location loc) : Lexemes(lexemes), loc(loc) {}
+
   void print(std::ostream& out) const;
 };
 
-struct Lexer::Lines : std::vector<Line> {
-  Lines() = default;
-  Lines(std::vector<Line> lines) : std::vector<Line>(lines) {}
+// Lines is a view of the lines in a Store. Copies share the store until one
+// of them is changed.
+struct Lexer::Lines {
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Line;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Line;
+
+    iterator() = default;
+    iterator(const Lines* lines, size_t i) : lines(lines), i(i) {}
+
+    Line operator*() const { return (*lines)[i]; }
+
+    iterator& operator++() {
+      i++;
+      return *this;
+    }
+
+    iterator operator++(int) {
+      auto it = *this;
+      i++;
+      return it;
+    }
+
+    bool operator==(const iterator& other) const { return i == other.i; }
+
+   private:
+    const Lines* lines = nullptr;
+    size_t i = 0;
+  };
+
+  Lines() : Lines(nullptr) {}
+  Lines(std::shared_ptr<Source> source);
+
+  // source keeps the bytes behind every lexeme alive.
+  const std::shared_ptr<Source>& source() const { return store->source; }
+
+  // interned returns the number of symbols that were interned when the lines
+  // were lexed.
+  size_t interned() const { return store->interned; }
+
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+  Line operator[](size_t i) const;
+  Line at(size_t i) const;
+
+  iterator begin() const { return {this, 0}; }
+  iterator end() const { return {this, size()}; }
+
+  // addLine adds a line with the given lexemes after the last line. The
+  // offsets must fit in 32 bits.
+  void addLine(Location loc, const std::vector<Lexeme>& lexemes);
 
   friend std::ostream& operator<<(std::ostream& out, const Lines& ls) {
     ls.print(out);
@@ -107,19 +396,43 @@ struct Lexer::Lines : std::vector<Line> {
   };
 
   // containingLine returns the line number that contains the given token or
-  // -1 if the token is not found.
+  // -1 if the token is not found. Lines are sorted by location, so this is a
+  // binary search.
   size_t containingLine(const Location& loc) const;
 
   // findCompleteLexeme returns the lexeme that covers the given token or the
   // given lexeme if it it's not found.
   Lexer::Lexeme findCompleteLexeme(const Lexer::Lexeme lexeme) const;
 
-  // removeComments returns a new list of lines with all comments removed.
+  // relativeLocation returns the given location relative to the start of the
+  // line of source text it starts on, which are its columns in that line. If
+  // the lines were not lexed from a buffer, it returns {-1, -1}.
+  Location relativeLocation(const Location& loc) const;
+
+  // removeComments returns a view of the lines without comments, which leaves
+  // out lines that only have comments.
   Lines removeComments() const;
 
-  // flatten returns a new list of tokens with all lines concatenated.
-  std::vector<Lexeme> flatten() const;
+  // flatten returns a view of the lexemes of all lines in order.
+  Lexemes flatten() const;
 
  private:
+  friend struct Lexer;
+
+  std::shared_ptr<Store> store;
+  bool comments = true;
+
+  // line returns the index in the store of the line at the given index.
+  size_t line(size_t i) const;
+
+  // mutableStore returns the store, copying it first if it is shared.
+  Store& mutableStore();
+
+  // append adds the lines of the store of other after the last line.
+  void append(const Lines& other);
+
+  // shrinkToFit frees the room the store has left to grow into.
+  void shrinkToFit();
+
   void print(std::ostream& out) const;
 };
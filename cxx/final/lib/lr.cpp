@@ -0,0 +1,195 @@
+#include "lr.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// splitRow splits a row of a CSV file at every comma.
+std::vector<std::string> splitRow(const std::string& line) {
+  std::vector<std::string> entries;
+  std::stringstream stream(line);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    entries.push_back(value);
+  }
+  return entries;
+}
+
+// number parses a cell that is only a number, or returns -1.
+long number(std::string_view text) {
+  long value = -1;
+  const auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  return error == std::errc() && end == text.data() + text.size() ? value : -1;
+}
+}  // namespace
+
+LRParser::LRParser(std::istream& table, std::istream& rules) {
+  load(table, rules);
+}
+
+LRParser::LRParser(const std::string& tablePath,
+                   const std::string& rulesPath) {
+  std::ifstream table(tablePath);
+  std::ifstream rules(rulesPath);
+  load(table, rules);
+}
+
+void LRParser::load(std::istream& table, std::istream& rulesFile) {
+  // The rules are read first, since their left sides are what tells the
+  // columns of non-terminals from those of terminals.
+  std::unordered_map<std::string, uint16_t> nonTerminalColumns;
+  std::vector<std::string> lefts;
+  std::string line;
+  while (std::getline(rulesFile, line)) {
+    const auto entries = splitRow(line);
+    if (entries.size() < 2 || entries[0].empty() || entries[1].empty()) {
+      continue;
+    }
+    lefts.push_back(entries[0]);
+    rules.push_back({static_cast<uint16_t>(entries[1].size()), 0});
+    nonTerminalColumns.emplace(entries[0], 0);
+  }
+  if (rules.size() > MAX_VALUE) {
+    throw std::invalid_argument("LR table: too many rules");
+  }
+
+  std::getline(table, line);
+  const auto header = splitRow(line);
+  std::vector<uint16_t> columnOfEntry(header.size());
+  std::vector<bool> isGoto(header.size());
+  for (size_t i = 1; i < header.size(); i++) {
+    if (const auto it = nonTerminalColumns.find(header[i]);
+        it != nonTerminalColumns.end()) {
+      it->second = static_cast<uint16_t>(nonTerminals);
+      columnOfEntry[i] = static_cast<uint16_t>(nonTerminals++);
+      isGoto[i] = true;
+    } else if (header[i].size() == 1) {
+      const auto c = static_cast<unsigned char>(header[i][0]);
+      if (columnOf[c] != 0) {
+        throw std::invalid_argument("LR table: column " + header[i] +
+                                    " is repeated");
+      }
+      columnOf[c] = static_cast<uint16_t>(columns);
+      columnOfEntry[i] = static_cast<uint16_t>(columns++);
+    } else {
+      throw std::invalid_argument("LR table: terminal " + header[i] +
+                                  " is not one character");
+    }
+  }
+  for (size_t r = 0; r < rules.size(); r++) {
+    rules[r].left = nonTerminalColumns[lefts[r]];
+  }
+
+  // Rows are numbered in order, except that the one named 0 comes first.
+  std::vector<std::vector<std::string>> rows;
+  std::unordered_map<std::string, State> stateOf;
+  while (std::getline(table, line)) {
+    auto entries = splitRow(line);
+    if (entries.empty() || entries[0].empty()) {
+      continue;
+    }
+    if (!stateOf.emplace(entries[0], 0).second) {
+      throw std::invalid_argument("LR table: state " + entries[0] +
+                                  " is repeated");
+    }
+    rows.push_back(std::move(entries));
+  }
+  if (!stateOf.contains("0")) {
+    throw std::invalid_argument("LR table: no state 0");
+  }
+  if (rows.size() > MAX_VALUE) {
+    throw std::invalid_argument("LR table: too many states");
+  }
+  State next = 1;
+  for (const auto& row : rows) {
+    stateOf[row[0]] = row[0] == "0" ? 0 : next++;
+  }
+
+  const auto state = [&](const std::string& name) {
+    const auto it = stateOf.find(name);
+    if (it == stateOf.end()) {
+      throw std::invalid_argument("LR table: no state " + name);
+    }
+    return it->second;
+  };
+  actions.assign(rows.size() * columns, ERROR);
+  gotos.assign(rows.size() * nonTerminals, NONE);
+  for (const auto& row : rows) {
+    const size_t s = stateOf[row[0]];
+    for (size_t i = 1; i < row.size() && i < header.size(); i++) {
+      const std::string& entry = row[i];
+      if (entry.empty()) {
+        continue;
+      }
+      if (isGoto[i]) {
+        gotos[s * nonTerminals + columnOfEntry[i]] = state(entry);
+        continue;
+      }
+
+      Action& action = actions[s * columns + columnOfEntry[i]];
+      const auto kind = std::tolower(static_cast<unsigned char>(entry[0]));
+      if (kind == 's') {
+        action = static_cast<Action>(state(entry.substr(1)) << 2 | SHIFT);
+      } else if (kind == 'r') {
+        const long rule = number(std::string_view(entry).substr(1));
+        if (rule < 1 || static_cast<size_t>(rule) > rules.size()) {
+          throw std::invalid_argument("LR table: no rule " + entry.substr(1));
+        }
+        action = static_cast<Action>((rule - 1) << 2 | REDUCE);
+      } else if (kind == 'a') {
+        action = ACCEPT;
+      } else {
+        throw std::invalid_argument("LR table: " + entry + " in state " +
+                                    row[0] + " is not an action");
+      }
+    }
+  }
+}
+
+bool LRParser::parse(std::string_view expression) {
+  if (expression.empty() || expression.back() != '$') {
+    return false;
+  }
+
+  stack.clear();
+  stack.push_back(0);
+  State state = 0;
+  size_t i = 0;
+  while (i < expression.size()) {
+    const auto c = static_cast<unsigned char>(expression[i]);
+    const Action action = actions[state * columns + columnOf[c]];
+    switch (action & KIND) {
+      case SHIFT:
+        state = action >> 2;
+        stack.push_back(state);
+        i++;
+        break;
+      case REDUCE: {
+        const Rule rule = rules[action >> 2];
+        if (rule.length >= stack.size()) {
+          return false;
+        }
+        stack.resize(stack.size() - rule.length);
+        state = gotos[stack.back() * nonTerminals + rule.left];
+        if (state == NONE) {
+          return false;
+        }
+        stack.push_back(state);
+        break;
+      }
+      case ACCEPT:
+        return true;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
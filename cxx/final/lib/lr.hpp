@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// LRParser is a shift-reduce parser driven by an LR parsing table in the CSV
+// format of LRExpressionParser in handout-08, which tools/generate-lr.cpp
+// writes. It accepts the same expressions, but the table is compiled when it
+// is loaded: states are numbered densely, every cell of the action table is
+// packed into 16 bits, and terminals, which are single characters, index the
+// columns through a table of bytes. Parsing then only reads arrays and keeps a
+// stack of states, without the symbols between them.
+class LRParser {
+ public:
+  typedef uint16_t State;
+
+  /**
+   * Instantiates a new LRParser object from the CSV of an LR parsing table
+   * and that of its rules.
+   * @param table The table: a header of State and a column per terminal and
+   * non-terminal, then a row per state whose cells are S<n>, R<n>, ACC, the
+   * state to go to, or empty. The state named 0 is the first.
+   * @param rules The rules, numbered from 1: a left side, and a right side
+   * with a character per symbol.
+   * @throws std::invalid_argument if the table or rules are malformed
+   */
+  LRParser(std::istream& table, std::istream& rules);
+  LRParser(const std::string& tablePath, const std::string& rulesPath);
+
+  /**
+   * Parses an expression a character at a time. Like for LRExpressionParser,
+   * expressions end with $.
+   * @param expression Expression that will be parsed.
+   * @return If the expression is accepted.
+   */
+  bool parse(std::string_view expression);
+
+  // states returns the number of states of the table.
+  size_t states() const { return actions.size() / columns; }
+
+ private:
+  // Action is a cell of the action table: a Kind in the low two bits, and the
+  // state to shift to or the rule to reduce by above them.
+  typedef uint16_t Action;
+  enum Kind : Action { ERROR, SHIFT, REDUCE, ACCEPT };
+  static constexpr Action KIND = 3;
+  static constexpr size_t MAX_VALUE = UINT16_MAX >> 2;
+
+  // NONE is every empty cell of the goto table.
+  static constexpr State NONE = UINT16_MAX;
+
+  struct Rule {
+    uint16_t length;  // of the right side
+    uint16_t left;    // the column of the left side in the goto table
+  };
+
+  // Column 0 of the action table is empty, for every character that is not a
+  // terminal.
+  std::array<uint16_t, 256> columnOf{};
+  size_t columns = 1;
+  size_t nonTerminals = 0;
+
+  std::vector<Action> actions;  // a row of columns per state
+  std::vector<State> gotos;     // a row of nonTerminals per state
+  std::vector<Rule> rules;
+
+  // stack is kept between parses so that it is only allocated once.
+  std::vector<State> stack;
+
+  // load compiles the table and rules. Call this once, from a constructor.
+  void load(std::istream& table, std::istream& rules);
+};
@@ -1,135 +1,703 @@
 #include "parser.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <optional>
-#include <stack>
+#include <vector>
 
-Parser::Parser(const Grammar& grammar) {
-  parsingTable = grammar.constructPredictiveParsingTable();
-  startingGrammar = grammar.getStartingGrammar();
+Parser::Parser(const Grammar& grammar)
+    : parsingTable(grammar.compileParsingTable()) {
+  start = Symbols::find(grammar.getStartingGrammar().first);
+  sigma = Symbols::find(SIGMA);
 
+  for (const auto& name : {std::string("$"), LAMBDA, SIGMA}) {
+    lastSymbol = std::max(lastSymbol, Symbols::find(name));
+  }
+  for (const auto& terminal : grammar.getTerminals()) {
+    lastSymbol = std::max(lastSymbol, Symbols::find(terminal));
+  }
+  for (const auto& nonTerminal : grammar.getNonTerminals()) {
+    lastSymbol = std::max(lastSymbol, Symbols::find(nonTerminal));
+  }
+
+  lexicalRules = grammar.getLexicalRules();
+  lexicalOf.assign(Symbols::size(), NO_RULE);
+  for (size_t i = 0; i < lexicalRules.size(); i++) {
+    lexicalOf[Symbols::find(lexicalRules[i].nonTerminal)] = i;
+  }
+
+  groups.resize(Symbols::size());
+  for (const auto& group : grammar.getGroups()) {
+    groups[Symbols::find(group)] = true;
+  }
+
+  bindings.resize(Symbols::size());
+  for (const auto& op : grammar.getOperators()) {
+    auto& binding = bindings[Symbols::find(op.nonTerminal)];
+    binding.resize(Symbols::size());
+    binding[Symbols::find(op.terminal)] =
+        op.precedence << 1 | op.rightAssociative;
+  }
+
+  follows.resize(Symbols::size());
+  for (const auto& nonTerminal : grammar.getNonTerminals()) {
+    auto& follow = follows[Symbols::find(nonTerminal)];
+    follow.resize(Symbols::size());
+    for (const auto& terminal : grammar.getMembersOfFollow(nonTerminal)) {
+      follow[Symbols::find(terminal)] = true;
+    }
+  }
+
+  terminals.resize(Symbols::size());
+  reserved.resize(Symbols::size());
   for (const auto& terminal : grammar.getTerminals()) {
-    terminals.insert(terminal);
+    const auto symbol = Symbols::find(terminal);
+    terminals[symbol] = true;
     if (terminal.length() > 1 || terminal == LAMBDA) {
-      reserved.insert(terminal);
+      reserved[symbol] = true;
     }
   }
 }
 
-template <typename T>
-void push_vector(std::stack<T>& stack, const std::vector<T>& values) {
-  for (auto it = values.rbegin(); it != values.rend(); it++) {
-    stack.push(*it);
-  }
+namespace {
+// contains returns true if the given symbol is in the given set of symbols.
+// Symbols interned after the set was made are not in it.
+bool contains(const std::vector<bool>& symbols, Symbols::ID symbol) {
+  return symbol < symbols.size() && symbols[symbol];
 }
 
-// lexemeMatches returns true if the lexeme matches the expected value.
-bool lexemeMatches(Lexer::Lexeme lexeme, std::string expects) {
+// lexemeMatches returns true if the lexeme matches the expected terminal.
+bool lexemeMatches(const Lexer::Lexeme& lexeme, Symbols::ID expects,
+                   Symbols::ID sigma) {
   switch (lexeme.type) {
     case Lexer::Lexeme::STRING:
-      return expects == SIGMA;
+      return expects == sigma;
     default:
-      return expects == lexeme.value;
+      return expects == lexeme.symbol;
   }
 }
 
+// sentinel is an entry of the parse stack: a symbol to parse, or a
+// non-terminal to exit once everything above it is parsed.
 struct sentinel {
-  std::string type;
-  Lexer::Lexeme lexeme;
-  Parser::Token* node;
+  Symbols::ID type;
+  bool exit;
 };
 
-Parser::Program Parser::parse(const Lexer::Lines& file) const {
+// linesReader reads the lexemes of some lines in order.
+struct linesReader {
+  Lexer::Lexemes lexemes;
+  Lexer::Lexemes::iterator it;
+
+  linesReader(const Lexer::Lines& lines)
+      : lexemes(lines.flatten()), it(lexemes.begin()) {}
+
+  Lexer::Lexeme next() {
+    if (it == lexemes.end()) {
+      return Lexer::Lexeme();
+    }
+    return *it++;
+  }
+};
+
+// streamReader reads the lexemes of a token stream as they are lexed.
+struct streamReader {
+  Lexer::TokenStream& stream;
+
+  Lexer::Lexeme next() { return stream.next(); }
+};
+
+// rest returns what is left of a word after its first n bytes. Only a single
+// character is looked up as a symbol, since the rest of a word is otherwise
+// parsed a character at a time however it is spelled.
+Lexer::Lexeme rest(const Lexer::Lexeme& word, size_t n) {
+  const auto value = word.value.substr(n);
+  return Lexer::Lexeme(word.loc.start + n, word.loc.end, word.type, value,
+                       value.size() == 1 ? Symbols::find(value)
+                                         : Symbols::NONE);
+}
+
+// lexemeInput is the parser's view of its input. It reads lexemes from a
+// reader only when they are needed, and lets the parser consume words a piece
+// at a time, leaving the rest of a word as the next lexeme.
+template <class Reader>
+class lexemeInput {
+ public:
+  lexemeInput(Reader reader) : reader(reader) {}
+
+  // peek returns the next lexeme, or an EOF lexeme if there is none.
+  const Lexer::Lexeme& peek() {
+    if (!read) {
+      next = buffered ? after : reader.next();
+      buffered = false;
+      partial = false;
+      read = true;
+    }
+    return next;
+  }
+
+  // following returns the lexeme after the next one, ignoring the rest of
+  // the next lexeme.
+  const Lexer::Lexeme& following() {
+    peek();
+    if (!buffered) {
+      after = reader.next();
+      buffered = true;
+    }
+    return after;
+  }
+
+  // isRest returns true if the next lexeme is the rest of a word, which is
+  // never a reserved word.
+  bool isRest() const { return partial; }
+
+  // consume consumes the first n bytes of the next lexeme.
+  void consume(size_t n) {
+    if (n == next.value.size()) {
+      read = false;
+      return;
+    }
+    next = rest(next, n);
+    partial = true;
+  }
+
+ private:
+  Reader reader;
+  Lexer::Lexeme next;
+  Lexer::Lexeme after;
+  bool read = false;
+  bool partial = false;
+  bool buffered = false;  // if after was read
+};
+}  // namespace
+
+void Parser::checkLines(const Lexer::Lines& file) const {
+  if (file.interned() <= lastSymbol) {
+    throw std::logic_error("lines were lexed before the grammar was loaded");
+  }
   if (file.empty()) {
     throw Parser::SyntaxError(file, Lexer::Lexeme(), "empty file");
   }
+}
 
-  std::stack<Lexer::Lexeme> lexemeStack;
-  push_vector(lexemeStack, file.flatten());
+// Parser::TreeBuilder builds the tree of a program as it is parsed. It is
+// final so that the parse calls it directly instead of through the vtable.
+class Parser::TreeBuilder final : public Parser::ParseListener {
+ public:
+  TreeBuilder(const Parser& parser, Tree& tree) : parser(parser), tree(tree) {
+    nodes.reserve(STACK_RESERVE);
+  }
 
-  Parser::Program root(file);
+  void enterNonTerminal(Symbols::ID nonTerminal) override {
+    if (nodes.empty()) {
+      tree.setType(Tree::ROOT, nonTerminal);
+      nodes.push_back(Tree::ROOT);
+      return;
+    }
+    nodes.push_back(tree.add(nodes.back(), nonTerminal));
+  }
 
-  // Adds initials to the stack
-  std::stack<sentinel> parseStack;
-  parseStack.push(sentinel{"$", Lexer::Lexeme(), nullptr});
-  parseStack.push(sentinel{startingGrammar.first, lexemeStack.top(), &root});
-
-  while (!parseStack.empty() && !lexemeStack.empty()) {
-    auto lexeme = lexemeStack.top();
-    if (lexeme.type == Lexer::Lexeme::WORD && lexeme.value.length() > 1) {
-      if (!reserved.contains(lexeme.value)) {
-        // Replace the lexeme with the split lexemes.
-        lexemeStack.pop();
-        push_vector(lexemeStack, lexeme.separate());
-        continue;
-      }
+  // Expressions are folded once everything in them is parsed.
+  void exitNonTerminal(Symbols::ID nonTerminal) override {
+    if (nonTerminal < parser.bindings.size() &&
+        !parser.bindings[nonTerminal].empty()) {
+      parser.foldExpression(tree, nodes.back(), folding);
     }
+    nodes.pop_back();
+  }
 
-    auto top = parseStack.top();
-    parseStack.pop();
+  // A $ that is matched after the program is not part of it.
+  void terminal(const Lexer::Lexeme& lexeme) override {
+    if (!nodes.empty()) {
+      tree.add(nodes.back(), lexeme);
+    }
+  }
+
+ private:
+  const Parser& parser;
+  Tree& tree;
+  std::vector<Tree::Node> nodes;  // the non-terminals being parsed
+  FoldStacks folding;
+};
 
-    Parser::Token* node = top.node;
-    const std::string type = top.type;
+// Parser::throwing throws every syntax error.
+struct Parser::throwing {
+  template <class Make>
+  bool report(Make make) {
+    throw make();
+  }
 
-    if (terminals.contains(type)) {
-      if (!lexemeMatches(lexeme, type)) {
-        throw Parser::SyntaxError(
-            file, lexeme, "unexpected terminal token, expecting " + type);
-      }
-      node->add(lexeme);
-      lexemeStack.pop();
+  void matched() {}
+};
+
+// Parser::recovering records syntax errors until there are maxErrors of them,
+// except those that come before a lexeme is matched after the last one.
+struct Parser::recovering {
+  std::vector<SyntaxError> errors;
+  size_t maxErrors;
+  bool quiet = false;  // if no lexeme was matched since the last error
+
+  // report records the error that make makes, and returns false once the
+  // parse has to stop.
+  template <class Make>
+  bool report(Make make) {
+    if (!quiet) {
+      errors.push_back(make());
+      quiet = true;
+    }
+    return errors.size() < maxErrors;
+  }
+
+  void matched() { quiet = false; }
+};
+
+Parser::Program Parser::parse(const Lexer::Lines& file) const {
+  checkLines(file);
+
+  Parser::Program root(file);
+  TreeBuilder builder(*this, *root.nodes);
+  throwing errors;
+  parseLines(file, builder, errors);
+  if (root.nodes->type(Tree::ROOT) == Symbols::NONE) {
+    throw std::logic_error("unexpected root node is EOF");
+  }
+  root.finish();
+  return root;
+}
+
+Parser::Program Parser::parse(Lexer::TokenStream& stream) const {
+  Parser::Program root(stream.source());
+  TreeBuilder builder(*this, *root.nodes);
+  parseStream(stream, builder);
+  if (root.nodes->type(Tree::ROOT) == Symbols::NONE) {
+    throw std::logic_error("unexpected root node is EOF");
+  }
+  root.finish();
+  return root;
+}
+
+void Parser::parse(const Lexer::Lines& file, ParseListener& listener) const {
+  checkLines(file);
+
+  throwing errors;
+  parseLines(file, listener, errors);
+}
+
+void Parser::parse(Lexer::TokenStream& stream,
+                   ParseListener& listener) const {
+  parseStream(stream, listener);
+}
+
+Parser::Recovered Parser::parseAll(const Lexer::Lines& file,
+                                   size_t maxErrors) const {
+  Parser::Program root(file);
+  recovering errors{{}, maxErrors};
+  try {
+    checkLines(file);
+  } catch (const SyntaxError& error) {
+    errors.errors.push_back(error);
+    root.finish();
+    return {std::move(root), std::move(errors.errors)};
+  }
+
+  TreeBuilder builder(*this, *root.nodes);
+  parseLines(file, builder, errors);
+  root.finish();
+  return {std::move(root), std::move(errors.errors)};
+}
+
+std::vector<Parser::SyntaxError> Parser::parseAll(const Lexer::Lines& file,
+                                                  ParseListener& listener,
+                                                  size_t maxErrors) const {
+  recovering errors{{}, maxErrors};
+  try {
+    checkLines(file);
+  } catch (const SyntaxError& error) {
+    errors.errors.push_back(error);
+    return errors.errors;
+  }
+
+  parseLines(file, listener, errors);
+  return errors.errors;
+}
+
+template <class Listener, class Errors>
+void Parser::parseLines(const Lexer::Lines& file, Listener& listener,
+                        Errors& errors) const {
+  lexemeInput input(linesReader{file});
+  parseInput(
+      input, listener,
+      [&file](Lexer::Lexeme lexeme, std::string message) {
+        return Parser::SyntaxError(file, lexeme, message);
+      },
+      errors);
+}
+
+template <class Listener>
+void Parser::parseStream(Lexer::TokenStream& stream,
+                         Listener& listener) const {
+  // Errors are reported against the lines of the program, which only exist
+  // once the whole source has been lexed again.
+  auto fail = [source = stream.source()](Lexer::Lexeme lexeme,
+                                         std::string message) {
+    Lexer::TokenStream relex(source, Lexer::SKIP_COMMENTS);
+    return Parser::SyntaxError(
+        std::make_shared<const Lexer::Lines>(Lexer::lex(relex)), lexeme,
+        message);
+  };
+
+  lexemeInput input(streamReader{stream});
+  if (input.peek().isEOF()) {
+    throw fail(Lexer::Lexeme(), "empty file");
+  }
+  throwing errors;
+  parseInput(input, listener, fail, errors);
+}
+
+template <class Input, class Listener, class Fail, class Errors>
+void Parser::parseInput(Input& input, Listener& listener, Fail fail,
+                        Errors& errors) const {
+  // The stack only grows past its reserve for deeply nested programs, so the
+  // loop allocates nothing but what the listener does.
+  std::vector<sentinel> parseStack;
+  parseStack.reserve(STACK_RESERVE);
+  const Symbols::ID end = Symbols::find("$");
+  parseStack.push_back(sentinel{end, false});
+  parseStack.push_back(sentinel{start, false});
+
+  while (!parseStack.empty() && !input.peek().isEOF()) {
+    // Words that are not reserved are parsed a character at a time, except
+    // where a lexical rule matches more of them at once.
+    const auto& next = input.peek();
+    const bool word = next.type == Lexer::Lexeme::WORD &&
+                      (input.isRest() || !contains(reserved, next.symbol));
+    const auto lexeme =
+        word && next.value.length() > 1 ? next.slice(0, 1) : next;
+
+    const sentinel top = parseStack.back();
+    parseStack.pop_back();
+
+    const Symbols::ID type = top.type;
+    if (top.exit) {
+      listener.exitNonTerminal(type);
       continue;
     }
 
-    std::vector<std::string> tableEntry;
-    try {
-      std::string value = lexeme.value;
-      if (lexeme.type == Lexer::Lexeme::Type::STRING) {
-        // All string literals are represented as a sigma in the table.
-        // Mask the value as a sigma before looking up in the table.
-        value = SIGMA;
+    if (contains(terminals, type)) {
+      // A terminal that does not match is taken to be missing.
+      if (!lexemeMatches(lexeme, type, sigma)) {
+        if (!errors.report(
+                [&]() { return fail(lexeme, terminalError(type)); })) {
+          return;
+        }
+        continue;
       }
-      tableEntry = parsingTable.at(type).at(value);
-    } catch (const std::exception& exception) {
-      if (errorEntryTable.contains(type)) {
-        const auto errors = errorEntryTable.at(type);
-        if (errors.contains(lexeme.value)) {
-          throw Parser::SyntaxError(file, lexeme, errors.at(lexeme.value));
+      errors.matched();
+      listener.terminal(lexeme);
+      input.consume(lexeme.value.size());
+      continue;
+    }
+
+    const size_t matched =
+        word ? matchWord(type, next.value, input.following()) : 0;
+    auto production = Grammar::CompiledTable::ERROR;
+    if (matched == 0) {
+      // All string literals are represented as a sigma in the table.
+      const Symbols::ID value =
+          lexeme.type == Lexer::Lexeme::Type::STRING ? sigma : lexeme.symbol;
+      production = parsingTable.lookup(type, value);
+      if (production == Grammar::CompiledTable::ERROR) {
+        if (!errors.report([&]() {
+              return fail(lexeme, nonTerminalError(type, lexeme));
+            })) {
+          return;
         }
-        if (errors.contains("?")) {
-          throw Parser::SyntaxError(file, lexeme, errors.at("?"));
+
+        // The lexeme is skipped and the non-terminal parsed again, unless the
+        // lexeme follows it, in which case it is taken to be missing.
+        if (type >= follows.size() || !contains(follows[type], value)) {
+          input.consume(lexeme.value.size());
+          parseStack.push_back(sentinel{type, false});
         }
+        continue;
       }
-      throw Parser::SyntaxError(file, lexeme,
-                                "unexpected non-terminal, expecting " + type);
     }
 
-    if (node->isEOF()) {
-      // Probably root not initialized.
-      node->type = type;
-    } else {
-      // Append a new node.
-      node = node->add(Parser::Token(type))->getToken();
+    const bool group = contains(groups, type);
+    if (!group) {
+      listener.enterNonTerminal(type);
     }
 
-    // Adds to stack based on the entry in the table.
-    for (auto it = tableEntry.rbegin(); it != tableEntry.rend(); it++) {
-      // Ignore lambda terminals
-      if (*it != LAMBDA) {
-        parseStack.push(sentinel{*it, lexeme, node});
+    if (matched > 0) {
+      errors.matched();
+      listener.terminal(matched == next.value.size() ? next
+                                                     : next.slice(0, matched));
+      input.consume(matched);
+      if (!group) {
+        listener.exitNonTerminal(type);
       }
+      continue;
+    }
+
+    // Adds to stack based on the entry in the table, below which the
+    // non-terminal is exited.
+    if (!group) {
+      parseStack.push_back(sentinel{type, true});
+    }
+    const auto right = parsingTable.rightSide(production);
+    for (auto it = right.rbegin(); it != right.rend(); it++) {
+      parseStack.push_back(sentinel{*it, false});
     }
   }
 
-  if (root.isEOF()) {
-    throw std::logic_error("unexpected root node is EOF");
+  // At the end of the input, the non-terminals left are expanded by their
+  // entries for $, which derive nothing, and exited. Anything else but $ is
+  // missing, so the program ended too early.
+  while (!parseStack.empty()) {
+    const sentinel top = parseStack.back();
+    parseStack.pop_back();
+
+    const Symbols::ID type = top.type;
+    if (top.exit) {
+      listener.exitNonTerminal(type);
+      continue;
+    }
+    if (type == end) {
+      continue;
+    }
+
+    const auto production = contains(terminals, type)
+                                ? Grammar::CompiledTable::ERROR
+                                : parsingTable.lookup(type, end);
+    if (production == Grammar::CompiledTable::ERROR) {
+      errors.report(
+          [&]() { return fail(Lexer::Lexeme(), endOfFileError(type)); });
+      return;
+    }
+
+    if (!contains(groups, type)) {
+      listener.enterNonTerminal(type);
+      parseStack.push_back(sentinel{type, true});
+    }
+    const auto right = parsingTable.rightSide(production);
+    for (auto it = right.rbegin(); it != right.rend(); it++) {
+      parseStack.push_back(sentinel{*it, false});
+    }
+  }
+}
+
+size_t Parser::matchWord(Symbols::ID nonTerminal, std::string_view word,
+                         const Lexer::Lexeme& following) const {
+  if (nonTerminal >= lexicalOf.size() || lexicalOf[nonTerminal] == NO_RULE) {
+    return 0;
+  }
+  const auto& rule = lexicalRules[lexicalOf[nonTerminal]];
+  const size_t matched = rule.match(word);
+
+  if (matched == 0 || (matched == word.size() && following.isEOF())) {
+    return matched;
+  }
+
+  // If the terminal after the match cannot follow it, the word is parsed a
+  // character at a time instead, which fails with the usual error.
+  Symbols::ID after;
+  if (matched < word.size()) {
+    after = Symbols::find(word.substr(matched, 1));
+  } else if (following.type == Lexer::Lexeme::STRING) {
+    after = sigma;
+  } else if (following.type == Lexer::Lexeme::WORD &&
+             !contains(reserved, following.symbol)) {
+    after = Symbols::find(following.value.substr(0, 1));
+  } else {
+    after = following.symbol;
+  }
+  return rule.follows(after) ? matched : 0;
+}
+
+void Parser::foldExpression(Tree& tree, Tree::Node node,
+                            FoldStacks& stacks) const {
+  if (tree.count(node) <= 3) {
+    return;  // an operand, or a single operator already
+  }
+
+  // Operands and operators wait on stacks until an operator that binds less
+  // tightly comes, which joins the operands of the operators before it.
+  const auto& binding = bindings[tree.type(node)];
+  const auto bindingOf = [&](Tree::Node op) {
+    const Symbols::ID symbol = tree.literal(op).symbol;
+    return symbol < binding.size() ? binding[symbol] : 0;
+  };
+
+  // Expressions that are missing an operand, which parseAll leaves out when
+  // it recovers from an error, are left as they are.
+  if (tree.count(node) % 2 == 0) {
+    return;
+  }
+  bool operand = true;
+  for (auto child = tree.first(node); child != Tree::NONE;
+       child = tree.next(child), operand = !operand) {
+    if (!operand && (!tree.isLiteral(child) || bindingOf(child) == 0)) {
+      return;
+    }
+  }
+  auto& operands = stacks.operands;
+  auto& operators = stacks.operators;
+  operands.clear();
+  operators.clear();
+  // join joins the last two operands by the last operator into binary.
+  const auto join = [&](Tree::Node binary) {
+    const Tree::Node right = operands.back();
+    operands.pop_back();
+    tree.append(binary, operands.back());
+    operands.pop_back();
+    tree.append(binary, operators.back());
+    operators.pop_back();
+    tree.append(binary, right);
+  };
+  const auto reduce = [&]() {
+    const Tree::Node binary = tree.make(tree.type(node));
+    join(binary);
+    operands.push_back(binary);
+  };
+
+  // The children are detached from node first, and each one's sibling is
+  // found before it is appended to another node.
+  Tree::Node next = tree.first(node);
+  tree.clear(node);
+  for (bool operand = true; next != Tree::NONE; operand = !operand) {
+    const Tree::Node child = next;
+    next = tree.next(child);
+    if (operand) {
+      operands.push_back(child);
+      continue;
+    }
+    const uint32_t bound = bindingOf(child);
+    while (!operators.empty()) {
+      const uint32_t top = bindingOf(operators.back());
+      if ((top >> 1) < (bound >> 1) ||
+          ((top >> 1) == (bound >> 1) && (bound & 1) == 1)) {
+        break;
+      }
+      reduce();
+    }
+    operators.push_back(child);
+  }
+  while (operators.size() > 1) {
+    reduce();
+  }
+  join(node);
+}
+
+std::string Parser::terminalError(Symbols::ID terminal) {
+  return "unexpected terminal token, expecting " +
+         std::string(Symbols::name(terminal));
+}
+
+std::string Parser::endOfFileError(Symbols::ID expected) {
+  return "unexpected end of file, expecting " +
+         std::string(Symbols::name(expected));
+}
+
+std::string Parser::nonTerminalError(Symbols::ID nonTerminal,
+                                     const Lexer::Lexeme& lexeme) const {
+  const std::string name(Symbols::name(nonTerminal));
+  if (errorEntryTable.contains(name)) {
+    const auto& errors = errorEntryTable.at(name);
+    const std::string value(lexeme.value);
+    if (errors.contains(value)) {
+      return errors.at(value);
+    }
+    if (errors.contains("?")) {
+      return errors.at("?");
+    }
+  }
+  return "unexpected non-terminal, expecting " + name;
+}
+
+Parser::Descent::Descent(const Parser& parser,
+                         std::span<const std::string_view> terminals,
+                         std::span<const std::string_view> nonTerminals)
+    : parser(parser), end(Symbols::find("$")), sigma(OTHER) {
+  for (const auto name : nonTerminals) {
+    this->nonTerminals.push_back(Symbols::find(name));
+  }
+
+  terminalOf.assign(Symbols::size(), OTHER);
+  for (const auto name : terminals) {
+    const Symbols::ID symbol = Symbols::find(name);
+    if (symbol == Symbols::NONE) {
+      throw std::logic_error(
+          "the grammar of a generated parser was not loaded");
+    }
+    terminalOf[symbol] = terminalSymbols.size();
+    terminalSymbols.push_back(symbol);
   }
+  sigma = terminalOf[parser.sigma];
+}
+
+Parser::Program Parser::Descent::parse(const Lexer::Lines& file) {
+  parser.checkLines(file);
+
+  Program root(file);
+  this->file = &file;
+  tree = root.nodes.get();
+  lexemes = file.flatten();
+  it = lexemes.begin();
+  consumed = true;
+  read = false;
 
+  // The parse fails on the lexemes after the program, which Parser::parse
+  // expands $ by.
+  start(Tree::ROOT);
+  if (next() != END) {
+    fail(end);
+  }
+  if (tree->type(Tree::ROOT) == Symbols::NONE) {
+    throw std::logic_error("unexpected root node is EOF");
+  }
+  root.finish();
   return root;
 }
 
+void Parser::Descent::advance() {
+  if (consumed) {
+    word = it != lexemes.end() ? *it++ : Lexer::Lexeme();
+    consumed = false;
+    partial = false;
+  }
+  isWord = word.type == Lexer::Lexeme::WORD &&
+           (partial || !contains(parser.reserved, word.symbol));
+  lexeme = isWord && word.value.length() > 1 ? word.slice(0, 1) : word;
+
+  read = true;
+  if (lexeme.isEOF()) {
+    terminal = END;
+  } else if (lexeme.type == Lexer::Lexeme::STRING) {
+    terminal = sigma;
+  } else {
+    terminal = lexeme.symbol < terminalOf.size() ? terminalOf[lexeme.symbol]
+                                                 : OTHER;
+  }
+}
+
+void Parser::Descent::shorten(size_t n) {
+  word = rest(word, n);
+  partial = true;
+}
+
+const Lexer::Lines& Parser::Program::file() const {
+  if (lines != nullptr) {
+    return *lines;
+  }
+  if (!relexed) {
+    Lexer::TokenStream relex(source, Lexer::SKIP_COMMENTS);
+    relexed = std::make_shared<const Lexer::Lines>(Lexer::lex(relex));
+  }
+  return *relexed;
+}
+
 void Parser::loadErrorEntries(std::string path) {
   std::ifstream f(path);
   Parser::loadErrorEntries(f);
@@ -159,12 +727,27 @@ void Parser::loadErrorEntries(std::istream& errorEntries) {
   }
 }
 
+namespace {
 void indent(std::ostream& out, int level) {
   for (int i = 0; i < level; i++) {
     out << "  ";
   }
 }
 
+// quote writes a value like std::quoted does, without formatting it into a
+// string first.
+void quote(std::ostream& out, std::string_view value) {
+  out.put('"');
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      out.put('\\');
+    }
+    out.put(c);
+  }
+  out.put('"');
+}
+}  // namespace
+
 std::string Parser::SyntaxError::formatError(const Lexer::Lines& file,
                                              Lexer::Lexeme lexeme,
                                              std::string message) {
@@ -174,63 +757,110 @@ std::string Parser::SyntaxError::formatError(const Lexer::Lines& file,
   return ss.str();
 }
 
-void Parser::Token::print(std::ostream& out, int level) const {
-  for (size_t i = 0; i < children.size(); i++) {
-    const auto& child = children[i];
-    indent(out, level);
-    switch (child.type) {
-      case Parser::Token::Value::Type::LITERAL:
-        out << std::quoted(child.getLiteral().value) << std::endl;
-        break;
-      case Parser::Token::Value::Type::TOKEN:
-        out << child.getToken().type << std::endl;
-        child.getToken().print(out, level + 1);
-        break;
-      default:
-        throw std::logic_error("unexpected token type");
+Parser::FlatTree::FlatTree(Tree&& tree)
+    : literals(std::move(tree.literals)),
+      treeAllocations(tree.nodes.allocations()) {
+  nodes.reserve(tree.size());
+
+  // Nodes are added as they are reached, and the end of a node is set once
+  // all of its children have been added. open holds the nodes whose children
+  // are being added, with the next child to add.
+  struct opened {
+    Node node;
+    Tree::Node next;
+  };
+  std::vector<opened> open;
+  uint32_t literal = 0;  // the next literal in order
+  const auto add = [&](Tree::Node from) {
+    const Node node = static_cast<Node>(nodes.size());
+    if (tree.isLiteral(from)) {
+      if (tree.nodes[from].literal != literal) {
+        throw std::logic_error("FlatTree: literals are out of order");
+      }
+      nodes.push_back({Symbols::NONE, node + 1, 0, literal++});
+      return;
+    }
+    nodes.push_back({tree.type(from), node + 1, tree.count(from), literal});
+    if (tree.count(from) > 0) {
+      open.push_back({node, tree.first(from)});
     }
+  };
+
+  add(Tree::ROOT);
+  while (!open.empty()) {
+    const Tree::Node next = open.back().next;
+    if (next == Tree::NONE) {
+      nodes[open.back().node].end = static_cast<Node>(nodes.size());
+      open.pop_back();
+      continue;
+    }
+    open.back().next = tree.next(next);
+    add(next);
   }
 }
 
-template <class T>
-Parser::Token::Value* Parser::Token::add(const T& value) {
-  return &children.emplace_back(value);
+void Parser::Token::print(std::ostream& out, int level) const {
+  if (tree == nullptr) {
+    return;
+  }
+
+  // ends holds the ends of the tokens around the node being printed, which
+  // is printed a level deeper than the token for each of them.
+  std::vector<FlatTree::Node> ends;
+  for (auto n = node + 1; n < tree->end(node); n++) {
+    while (!ends.empty() && ends.back() <= n) {
+      ends.pop_back();
+    }
+    indent(out, level + static_cast<int>(ends.size()));
+    if (tree->isLiteral(n)) {
+      quote(out, tree->literal(n).value);
+      out << '\n';
+    } else {
+      out << Symbols::name(tree->type(n)) << '\n';
+      ends.push_back(tree->end(n));
+    }
+  }
 }
 
 Lexer::Location Parser::Token::location() const {
   Lexer::Location loc;
-  for (const auto& child : children) {
-    switch (child.type) {
-      case Value::Type::TOKEN:
-        loc = loc.merge(child.getToken().location());
-        break;
-      case Value::Type::LITERAL:
-        loc = loc.merge(child.getLiteral().loc);
-        break;
-      default:
-        break;
-    }
+  if (tree == nullptr) {
+    return loc;
+  }
+  for (auto i = tree->firstLiteral(node); i < tree->endLiteral(node); i++) {
+    loc = loc.merge(tree->literalAt(i).loc);
   }
   return loc;
 }
 
 std::string Parser::Token::extractLiterals() const {
-  std::stringstream buf;
-  std::function<void(const Parser::Token&)> rec;
-  rec = [&buf, &rec](const Parser::Token& token) {
-    for (const auto& child : token.children) {
-      switch (child.type) {
-        case Parser::Token::Value::Type::LITERAL:
-          buf << child.getLiteral();
-          break;
-        case Parser::Token::Value::Type::TOKEN:
-          rec(child.getToken());
-          break;
-        default:
-          break;
-      }
+  std::string literals;
+  if (tree == nullptr) {
+    return literals;
+  }
+  for (auto i = tree->firstLiteral(node); i < tree->endLiteral(node); i++) {
+    // Only strings and comments are printed as something else than their
+    // values.
+    const auto& literal = tree->literalAt(i);
+    if (literal.type == Lexer::Lexeme::WORD ||
+        literal.type == Lexer::Lexeme::PUNCT) {
+      literals += literal.value;
+    } else {
+      std::stringstream buf;
+      buf << literal;
+      literals += buf.str();
     }
-  };
-  rec(*this);
-  return buf.str();
+  }
+  return literals;
+}
+
+Parser::Token::Value Parser::Token::Children::at(size_t index) const {
+  if (index >= count) {
+    throw std::out_of_range("Children::at: child out of range");
+  }
+  FlatTree::Node node = first;
+  for (size_t i = 0; i < index; i++) {
+    node = tree->end(node);
+  }
+  return Value(tree, node);
 }
@@ -1,21 +1,35 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "error.hpp"
 #include "grammar.hpp"
 #include "lexer.hpp"
+#include "symbols.hpp"
 
 class Parser {
  public:
   class SyntaxError;
+  class Tree;
+  class FlatTree;
   class Token;
   class Program;
+  class ParseListener;
+  struct Recovered;
+  class Descent;
+
+  // MAX_ERRORS is how many syntax errors parseAll records by default.
+  static constexpr size_t MAX_ERRORS = 100;
 
   /**
    * Instantiates a new ProgramParser object.
@@ -30,6 +44,47 @@ class Parser {
    */
   Program parse(const Lexer::Lines& file) const;
 
+  /**
+   * Compiles the program read from the given stream, pulling lexemes from it
+   * only as the parse needs them. Comments are skipped.
+   */
+  Program parse(Lexer::TokenStream& stream) const;
+
+  /**
+   * Parses the given program like parse does, but tells the listener what the
+   * parse finds as it finds it instead of building a tree, so that it takes
+   * no memory besides the parse stack.
+   * @param file Lines of the program, without comments.
+   * @param listener Listener of the non-terminals and terminals parsed.
+   */
+  void parse(const Lexer::Lines& file, ParseListener& listener) const;
+  void parse(Lexer::TokenStream& stream, ParseListener& listener) const;
+
+  /**
+   * Compiles the given program like parse, but records syntax errors and
+   * recovers from them in panic mode instead of stopping at the first one. A
+   * terminal that does not match is taken to be missing. Lexemes that no
+   * grammar entry of the expected non-terminal starts with are skipped up to
+   * one that it starts with, or that follows it, in which case the
+   * non-terminal is taken to be missing. The errors that come before another
+   * lexeme is matched are not recorded, since they are usually caused by the
+   * one before them.
+   * @param file Lines of the program, without comments.
+   * @param maxErrors How many errors to record before the parse stops.
+   * @return The program as far as it was parsed, and its syntax errors.
+   */
+  Recovered parseAll(const Lexer::Lines& file,
+                     size_t maxErrors = MAX_ERRORS) const;
+
+  /**
+   * Parses the given program like parseAll, telling the listener what the
+   * parse finds like parse does.
+   * @return The syntax errors of the program.
+   */
+  std::vector<SyntaxError> parseAll(const Lexer::Lines& file,
+                                    ParseListener& listener,
+                                    size_t maxErrors = MAX_ERRORS) const;
+
   /**
    * Loads the error entry message file into the parser. This specifies what
    * type of error messages are printed dependent on the invalid entry during
@@ -42,14 +97,97 @@ class Parser {
   std::unordered_map<std::string, std::unordered_map<std::string, std::string>>
       errorEntryTable;
 
-  std::unordered_map<std::string,
-                     std::map<std::string, std::vector<std::string>>>
-      parsingTable;
+  // parsingTable maps a non-terminal and the symbol of the next lexeme to the
+  // symbols the non-terminal expands to, without λ.
+  Grammar::CompiledTable parsingTable;
+
+  Symbols::ID start;  // the non-terminal of the starting grammar rule
+  Symbols::ID sigma;  // stands for every string literal
+
+  // lastSymbol is the largest symbol of the grammar, which lines must have
+  // been lexed after to be tagged with all of its symbols.
+  Symbols::ID lastSymbol = Symbols::NONE;
 
-  std::pair<std::string, std::vector<std::string>> startingGrammar;
+  // reserved and terminals are indexed by symbol. Reserved words are the
+  // terminals that are not split into characters.
+  std::vector<bool> reserved;
+  std::vector<bool> terminals;
 
-  std::unordered_set<std::string> reserved;
-  std::unordered_set<std::string> terminals;
+  // groups is indexed by symbol. What a group derives is added to the node
+  // that the group is in, instead of to a node of its own.
+  std::vector<bool> groups;
+
+  // Expressions are parsed as a flat list of operands and operators, which is
+  // then folded into binary nodes. bindings holds, for each expression by
+  // symbol, the binding of each of its operators by symbol: its precedence
+  // shifted left by one and ORed with 1 if it is right-associative, or 0 if
+  // the symbol is not one of its operators.
+  std::vector<std::vector<uint32_t>> bindings;
+
+  // follows holds, for each non-terminal by symbol, the terminals that may
+  // follow it by symbol, which parseAll skips lexemes up to.
+  std::vector<std::vector<bool>> follows;
+
+  // Lexical rules are matched against words instead of being expanded a
+  // character at a time. lexicalOf holds the rule of each symbol, if any.
+  static constexpr uint32_t NO_RULE = UINT32_MAX;
+  std::vector<Grammar::LexicalRule> lexicalRules;
+  std::vector<uint32_t> lexicalOf;
+
+  template <class T>
+  class chunks;
+
+  // TreeBuilder is the listener that builds the trees of programs.
+  class TreeBuilder;
+
+  // Parses report syntax errors to an Errors, which either throws them or
+  // records them and recovers.
+  struct throwing;
+  struct recovering;
+
+  template <class Listener, class Errors>
+  void parseLines(const Lexer::Lines& file, Listener& listener,
+                  Errors& errors) const;
+  template <class Listener>
+  void parseStream(Lexer::TokenStream& stream, Listener& listener) const;
+  template <class Input, class Listener, class Fail, class Errors>
+  void parseInput(Input& input, Listener& listener, Fail fail,
+                  Errors& errors) const;
+
+  // matchWord returns how much of the given word, which is not a reserved
+  // word, the lexical rule of the non-terminal matches, or 0 if the
+  // non-terminal has no lexical rule or the word has to be parsed a character
+  // at a time. following is the lexeme after the word.
+  size_t matchWord(Symbols::ID nonTerminal, std::string_view word,
+                   const Lexer::Lexeme& following) const;
+
+  // checkLines throws if the given lines cannot be parsed at all.
+  void checkLines(const Lexer::Lines& file) const;
+
+  // FoldStacks holds the stacks of foldExpression, which are kept between
+  // expressions so that folding them allocates nothing once they are as deep
+  // as they need to be.
+  struct FoldStacks {
+    std::vector<uint32_t> operands;
+    std::vector<uint32_t> operators;
+  };
+
+  // STACK_RESERVE is how many entries parse stacks start with.
+  static constexpr size_t STACK_RESERVE = 256;
+
+  // foldExpression folds the operands and operators of a parsed expression
+  // into binary nodes of the expression, leaving node with the one that is
+  // applied last.
+  void foldExpression(Tree& tree, uint32_t node, FoldStacks& stacks) const;
+
+  // terminalError and nonTerminalError return the message of the error for a
+  // lexeme that does not match the expected terminal, or that no grammar entry
+  // of the expected non-terminal starts with. endOfFileError returns the
+  // message of the error for a program that ends before the expected symbol.
+  static std::string terminalError(Symbols::ID terminal);
+  static std::string endOfFileError(Symbols::ID expected);
+  std::string nonTerminalError(Symbols::ID nonTerminal,
+                               const Lexer::Lexeme& lexeme) const;
 };
 
 class Parser::SyntaxError : public std::runtime_error {
@@ -59,26 +197,299 @@ class Parser::SyntaxError : public std::runtime_error {
 
   SyntaxError(const Lexer::Lines& file, Lexer::Lexeme lexeme,
               std::string message)
-      : std::runtime_error(
-            formatError(file, file.findCompleteLexeme(lexeme), message)),
-        file(file),
-        lexeme(file.findCompleteLexeme(lexeme)) {}
+      : SyntaxError(file, file.findCompleteLexeme(lexeme), message,
+                    complete{}) {}
+
+  // This constructor keeps the given lines alive. It is used when the lines
+  // had to be lexed just for the error.
+  SyntaxError(std::shared_ptr<const Lexer::Lines> file, Lexer::Lexeme lexeme,
+              std::string message)
+      : SyntaxError(*file, lexeme, message) {
+    owned = file;
+  }
 
  private:
+  std::shared_ptr<const Lexer::Lines> owned;
+
+  // complete marks a lexeme that was already looked up in the file.
+  struct complete {};
+
+  SyntaxError(const Lexer::Lines& file, Lexer::Lexeme lexeme,
+              std::string message, complete)
+      : std::runtime_error(formatError(file, lexeme, message)),
+        file(file),
+        lexeme(lexeme) {}
+
   static std::string formatError(const Lexer::Lines& file, Lexer::Lexeme lexeme,
                                  std::string message);
 };
 
+// Parser::chunks is an array that grows by a chunk at a time. Chunks never
+// move, so growing never copies what is already stored.
+template <class T>
+class Parser::chunks {
+ public:
+  // SIZE is the number of entries of a chunk.
+  static constexpr size_t SIZE = size_t(1) << 14;
+
+  T& operator[](size_t i) { return stored[i / SIZE][i % SIZE]; }
+  const T& operator[](size_t i) const { return stored[i / SIZE][i % SIZE]; }
+
+  size_t size() const { return count; }
+  size_t bytes() const { return stored.size() * SIZE * sizeof(T); }
+
+  // allocations returns the number of allocations made: one per chunk, and
+  // one each time the array of chunks grew.
+  size_t allocations() const { return made; }
+
+  void push_back(const T& value) {
+    if (count % SIZE == 0) {
+      made += stored.size() == stored.capacity() ? 2 : 1;
+      stored.push_back(std::make_unique_for_overwrite<T[]>(SIZE));
+    }
+    (*this)[count++] = value;
+  }
+
+ private:
+  std::vector<std::unique_ptr<T[]>> stored;
+  size_t count = 0;
+  size_t made = 0;
+};
+
+// Parser::Tree is the arena a Program is built in, so that a tree is built
+// without allocating each of its nodes, and is freed a chunk of nodes at a time
+// instead of a node at a time. Nodes are numbered in the order they are made
+// and refer to each other by number: every node links to its first and last
+// child and to its next sibling, so that nodes can be added anywhere and moved,
+// like expressions are when they are folded. A node is either a non-terminal or
+// a literal, whose lexeme is stored apart from the nodes. Once a program is
+// parsed, its Tree is flattened into a FlatTree and freed.
+class Parser::Tree {
+ public:
+  typedef uint32_t Node;
+
+  // NONE is the node that no link points to.
+  static constexpr Node NONE = UINT32_MAX;
+
+  // ROOT is the node of the starting non-terminal, which every tree has. Its
+  // type is NONE until the parse expands it.
+  static constexpr Node ROOT = 0;
+
+  Tree() { make(Symbols::NONE); }
+
+  Symbols::ID type(Node node) const { return nodes[node].type; }
+  void setType(Node node, Symbols::ID type) { nodes[node].type = type; }
+
+  bool isLiteral(Node node) const { return nodes[node].literal != NONE; }
+  const Lexer::Lexeme& literal(Node node) const {
+    return literals[nodes[node].literal];
+  }
+
+  Node first(Node node) const { return nodes[node].first; }
+  Node next(Node node) const { return nodes[node].next; }
+  uint32_t count(Node node) const { return nodes[node].count; }
+
+  // make makes a node of the given non-terminal without a parent.
+  Node make(Symbols::ID type) {
+    if (nodes.size() == NONE) {
+      throw std::length_error("Tree: nodes do not fit in 32 bits");
+    }
+    nodes.push_back({type, NONE, NONE, NONE, NONE, 0});
+    return static_cast<Node>(nodes.size() - 1);
+  }
+
+  // append makes child, which has no parent, the last child of parent.
+  void append(Node parent, Node child) {
+    nodes[child].next = NONE;
+    Record& record = nodes[parent];
+    if (record.first == NONE) {
+      record.first = child;
+    } else {
+      nodes[record.last].next = child;
+    }
+    record.last = child;
+    record.count++;
+  }
+
+  // add adds a node of the given non-terminal to parent and returns it.
+  Node add(Node parent, Symbols::ID type) {
+    const Node node = make(type);
+    append(parent, node);
+    return node;
+  }
+
+  // add adds a literal to parent.
+  void add(Node parent, const Lexer::Lexeme& literal) {
+    const Node node = make(Symbols::NONE);
+    nodes[node].literal = static_cast<uint32_t>(literals.size());
+    literals.push_back(literal);
+    append(parent, node);
+  }
+
+  // clear leaves a node without children. They are left without a parent,
+  // but linked to their siblings until they are appended to another node.
+  void clear(Node node) {
+    nodes[node].first = nodes[node].last = NONE;
+    nodes[node].count = 0;
+  }
+
+  // size returns the number of nodes, and bytes the memory they take up.
+  size_t size() const { return nodes.size(); }
+  size_t bytes() const { return nodes.bytes() + literals.bytes(); }
+
+ private:
+  struct Record {
+    Symbols::ID type;  // NONE for literals
+    uint32_t literal;  // the index of the lexeme of a literal, or NONE
+    Node first;
+    Node last;
+    Node next;
+    uint32_t count;  // of children
+  };
+
+  friend class FlatTree;
+
+  chunks<Record> nodes;
+  chunks<Lexer::Lexeme> literals;  // in the order they are added
+};
+
+// Parser::FlatTree is a parsed program flattened into one array of nodes in
+// preorder, which is how a Program holds its tree. The first child of a node is
+// the node after it, and the next sibling of a node is the node at the end of
+// its subtree, so a token is walked by scanning the nodes of its subtree in
+// order instead of by following links. Literals are stored in the order they
+// appear in the program, which is the order a Tree stores them in too, and the
+// literals of a subtree are a range of them.
+class Parser::FlatTree {
+ public:
+  typedef uint32_t Node;
+
+  // ROOT is the node of the starting non-terminal.
+  static constexpr Node ROOT = 0;
+
+  // FlatTree flattens the given tree from its root, taking its literals.
+  explicit FlatTree(Tree&& tree);
+
+  Symbols::ID type(Node node) const { return nodes[node].type; }
+
+  bool isLiteral(Node node) const { return nodes[node].type == Symbols::NONE; }
+  const Lexer::Lexeme& literal(Node node) const {
+    return literals[nodes[node].literal];
+  }
+
+  // end returns the node after the subtree of a node, which is its next
+  // sibling if it has one.
+  Node end(Node node) const { return nodes[node].end; }
+  uint32_t count(Node node) const { return nodes[node].count; }
+
+  // firstLiteral and endLiteral return the range of the literals of the
+  // subtree of a node, which literalAt indexes.
+  size_t firstLiteral(Node node) const { return nodes[node].literal; }
+  size_t endLiteral(Node node) const {
+    const Node end = nodes[node].end;
+    return end < nodes.size() ? nodes[end].literal : literals.size();
+  }
+  const Lexer::Lexeme& literalAt(size_t i) const { return literals[i]; }
+
+  // size returns the number of nodes, and bytes the memory they take up.
+  size_t size() const { return nodes.size(); }
+  size_t bytes() const {
+    return nodes.capacity() * sizeof(Record) + literals.bytes();
+  }
+
+  // allocations returns the number of allocations that the chunks of nodes
+  // and literals of the Tree the nodes were flattened from made.
+  size_t allocations() const {
+    return treeAllocations + literals.allocations();
+  }
+
+ private:
+  struct Record {
+    Symbols::ID type;  // NONE for literals
+    Node end;
+    uint32_t count;    // of children
+    uint32_t literal;  // the lexeme of a literal, or else the first literal of
+                       // the subtree
+  };
+
+  std::vector<Record> nodes;
+  chunks<Lexer::Lexeme> literals;
+  size_t treeAllocations;  // of the chunks of nodes of the Tree
+};
+
+// Parser::Token is a node of the non-terminal of a parse tree, as a view into
+// the FlatTree that owns it. Tokens and the values of their children are small
+// handles, which are only valid as long as their Program is.
 class Parser::Token {
  public:
   class Value;  // I can't define this inline :(
-  friend class Parser;
 
-  std::string type;  // <prog>, <identifier>, <dec-list>, ...
-  std::vector<Value> children;
+  // Children is the children of a token, in order.
+  class Children {
+   public:
+    class iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = Value;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = Value;
+
+      iterator() = default;
+
+      Value operator*() const;
+      iterator& operator++() {
+        node = tree->end(node);
+        return *this;
+      }
+      iterator operator++(int) {
+        iterator before = *this;
+        ++*this;
+        return before;
+      }
+      bool operator==(const iterator& other) const {
+        return node == other.node;
+      }
+
+     private:
+      friend class Children;
+
+      const FlatTree* tree = nullptr;
+      FlatTree::Node node = 0;
+
+      iterator(const FlatTree* tree, FlatTree::Node node)
+          : tree(tree), node(node) {}
+    };
+
+    Children() = default;
+    Children(const FlatTree* tree, FlatTree::Node parent)
+        : tree(tree),
+          first(parent + 1),
+          last(tree->end(parent)),
+          count(tree->count(parent)) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    iterator begin() const { return {tree, first}; }
+    iterator end() const { return {tree, last}; }
+
+    // at returns the child at the given index, skipping the subtrees of the
+    // children before it.
+    Value at(size_t index) const;
+
+   private:
+    const FlatTree* tree = nullptr;
+    FlatTree::Node first = 0;
+    FlatTree::Node last = 0;  // the node after the last child's subtree
+    uint32_t count = 0;
+  };
 
-  Token() : type("$") {}
-  Token(const std::string& type) : type(type) {}
+  Symbols::ID type;  // <prog>, <identifier>, <dec-list>, ...
+  Children children;
+
+  Token() : type(Symbols::NONE) {}
+  Token(const FlatTree* tree, FlatTree::Node node)
+      : type(tree->type(node)), children(tree, node), tree(tree), node(node) {}
 
   friend std::ostream& operator<<(std::ostream& out, const Token& token) {
     token.print(out);
@@ -92,21 +503,49 @@ class Parser::Token {
   std::string extractLiterals() const;
 
  private:
-  bool isEOF() const { return type == "$"; }
-  void print(std::ostream& out, int level = 0) const;
+  friend class Parser;
 
-  template <class T>
-  Parser::Token::Value* add(const T& value);
+  const FlatTree* tree = nullptr;
+  FlatTree::Node node = 0;
+
+  bool isEOF() const { return type == Symbols::NONE; }
+  void print(std::ostream& out, int level = 0) const;
 };
 
 class Parser::Program : public Parser::Token {
  public:
   friend class Parser;
 
-  const Lexer::Lines& file;
+  // file returns the lines of the program without comments. A program parsed
+  // from a TokenStream has no lines, so they are lexed again from its source
+  // the first time they are needed, which is only for error messages.
+  const Lexer::Lines& file() const;
+
+  // tree returns the tree that holds the nodes of the program.
+  const FlatTree& tree() const { return *flat; }
 
  private:
-  Program(const Lexer::Lines& file) : Token(), file(file) {}
+  const Lexer::Lines* lines = nullptr;
+  std::shared_ptr<Lexer::Source> source;
+  mutable std::shared_ptr<const Lexer::Lines> relexed;
+
+  // nodes is the tree the program is parsed into, and flat the tree it is
+  // flattened into once it is parsed.
+  std::shared_ptr<Tree> nodes = std::make_shared<Tree>();
+  std::shared_ptr<const FlatTree> flat;
+
+  Program(const Lexer::Lines& file)
+      : Token(), lines(&file), source(file.source()) {}
+  Program(std::shared_ptr<Lexer::Source> source)
+      : Token(), source(source) {}
+
+  // finish flattens the tree of the program once it is parsed, and makes the
+  // program its root.
+  void finish() {
+    flat = std::make_shared<const FlatTree>(std::move(*nodes));
+    nodes.reset();
+    static_cast<Token&>(*this) = Token(flat.get(), FlatTree::ROOT);
+  }
 };
 
 class Parser::Token::Value {
@@ -120,43 +559,17 @@ class Parser::Token::Value {
   Type type;
 
   Value() : type(NONE) {}
-
-  Value(Token token) : type(TOKEN), token(std::make_unique<Token>(token)) {}
-
-  Value(Lexer::Lexeme literal)
-      : type(LITERAL), literal(std::make_unique<Lexer::Lexeme>(literal)) {}
-
-  Value(const Value& other) : type(other.type) {
-    switch (type) {
-      case NONE:
-        break;
-      case TOKEN:
-        token = std::make_unique<Token>(*other.token);
-        break;
-      case LITERAL:
-        literal = std::make_unique<Lexer::Lexeme>(*other.literal);
-        break;
-    }
-  }
-
-  Token* getToken() {
-    assertType(TOKEN);
-    return token.get();
-  }
+  Value(const FlatTree* tree, FlatTree::Node node)
+      : type(tree->isLiteral(node) ? LITERAL : TOKEN), tree(tree), node(node) {}
 
   Token getToken() const {
     assertType(TOKEN);
-    return *token;
-  }
-
-  Lexer::Lexeme* getLiteral() {
-    assertType(LITERAL);
-    return literal.get();
+    return Token(tree, node);
   }
 
-  Lexer::Lexeme getLiteral() const {
+  const Lexer::Lexeme& getLiteral() const {
     assertType(LITERAL);
-    return *literal;
+    return tree->literal(node);
   }
 
  private:
@@ -180,8 +593,194 @@ class Parser::Token::Value {
     }
   }
 
-  // I'm balls deep in this shit. I hate C++ so much.
-  // You can hardly pick a worse language for this university.
-  std::unique_ptr<Token> token;
-  std::unique_ptr<Lexer::Lexeme> literal;
+  const FlatTree* tree = nullptr;
+  FlatTree::Node node = 0;
+};
+
+inline Parser::Token::Value Parser::Token::Children::iterator::operator*()
+    const {
+  return Value(tree, node);
+}
+
+// Parser::Recovered is a program that was parsed by recovering from its
+// syntax errors. Its tree leaves out what could not be parsed.
+struct Parser::Recovered {
+  Program program;
+  std::vector<SyntaxError> errors;  // in the order they were found
+};
+
+// Parser::ParseListener is told what a parse finds, in the order of the
+// program. A non-terminal is entered when it is expanded and exited once all it
+// expands to is parsed, and every lexeme matched in between is a terminal of
+// it. Groups are not entered, since what they parse belongs to the
+// non-terminal they are in, and expressions are not folded: their operands and
+// operators are terminals and non-terminals of the expression in order. A
+// program that ends before the starting non-terminal is parsed is a syntax
+// error, and the non-terminals being parsed when the parse stops are not
+// exited.
+class Parser::ParseListener {
+ public:
+  virtual ~ParseListener() = default;
+
+  virtual void enterNonTerminal(Symbols::ID /* nonTerminal */) {}
+  virtual void exitNonTerminal(Symbols::ID /* nonTerminal */) {}
+  virtual void terminal(const Lexer::Lexeme& /* lexeme */) {}
+};
+
+// Parser::Descent is the base of the recursive-descent parsers that
+// tools/generate-parser.cpp generates from grammars. A generated parser has a
+// function per non-terminal, which switches on the terminal of the next lexeme
+// to pick the grammar entry to expand and then matches or calls the functions
+// of the symbols on its right side in turn, instead of looking the entry up in
+// the parsing table and pushing its right side on a stack. It builds the same
+// tree as Parser::parse and throws the same errors.
+//
+// Terminals are numbered in the order of the terminals of Grammar::Tables, and
+// the end of the input is parsed as $, so that a program that ends too early
+// fails where Parser::parse fails too. A Descent parses one program at a time
+// and must be used with a parser of the grammar it was generated from.
+class Parser::Descent {
+ public:
+  /**
+   * Compiles the given text file program like Parser::parse.
+   * @param file Lines of the program, without comments.
+   */
+  Program parse(const Lexer::Lines& file);
+
+  virtual ~Descent() = default;
+
+ protected:
+  typedef uint32_t Terminal;
+  typedef Tree::Node Node;
+
+  // OTHER is the terminal of lexemes that are not terminals of the grammar,
+  // and END is the terminal past the end of the input, which is parsed as $.
+  static constexpr Terminal OTHER = UINT32_MAX - 1;
+  static constexpr Terminal END = UINT32_MAX;
+
+  // nonTerminals is indexed by the number of a non-terminal in the order of
+  // Grammar::Tables.
+  std::vector<Symbols::ID> nonTerminals;
+
+  /**
+   * Instantiates the base of a generated parser.
+   * @param parser Parser of the grammar the parser was generated from
+   * @param terminals Terminals of the grammar in the order of Grammar::Tables
+   * @param nonTerminals Non-terminals in the order of Grammar::Tables
+   * @throws std::logic_error if the grammar was not loaded
+   */
+  Descent(const Parser& parser, std::span<const std::string_view> terminals,
+          std::span<const std::string_view> nonTerminals);
+
+  // start parses the starting non-terminal into root.
+  virtual void start(Node root) = 0;
+
+  // next returns the terminal of the next lexeme, which is split into
+  // characters first if it is a word that is not reserved.
+  Terminal next() {
+    if (!read) {
+      advance();
+    }
+    return terminal;
+  }
+
+  // match adds the next lexeme to node, and throws a SyntaxError if it is not
+  // the given terminal.
+  void match(Node node, Terminal expected) {
+    if (next() != expected) {
+      const Symbols::ID symbol = terminalSymbols[expected];
+      throw failure(lexeme.isEOF() ? endOfFileError(symbol)
+                                   : terminalError(symbol));
+    }
+    tree->add(node, lexeme);
+    consume(lexeme.value.size());
+  }
+
+  // scan adds a node of the given non-terminal to parent with as much of the
+  // next word as its lexical rule matches and returns true, or returns false
+  // if the non-terminal has to be expanded instead. Groups add the match to
+  // parent itself.
+  bool scan(Node parent, Symbols::ID nonTerminal) {
+    next();
+    const size_t matched =
+        isWord ? parser.matchWord(nonTerminal, word.value,
+                                  it != lexemes.end() ? *it : Lexer::Lexeme())
+               : 0;
+    if (matched == 0) {
+      return false;
+    }
+    Node node = parent;
+    if (nonTerminal >= parser.groups.size() || !parser.groups[nonTerminal]) {
+      node = expand(parent, nonTerminal);
+    }
+    tree->add(node,
+              matched == word.value.size() ? word : word.slice(0, matched));
+    consume(matched);
+    return true;
+  }
+
+  // fold folds a parsed expression into binary nodes.
+  void fold(Node node) { parser.foldExpression(*tree, node, folding); }
+
+  // expand adds a node of the given non-terminal to parent and returns it, or
+  // makes parent that node if it is the root of a program yet to be parsed.
+  Node expand(Node parent, Symbols::ID nonTerminal) {
+    if (tree->type(parent) == Symbols::NONE) {
+      tree->setType(parent, nonTerminal);
+      return parent;
+    }
+    return tree->add(parent, nonTerminal);
+  }
+
+  // fail throws the SyntaxError for a next lexeme that no grammar entry of the
+  // given non-terminal starts with, or for the end of the input.
+  [[noreturn]] void fail(Symbols::ID nonTerminal) const {
+    throw failure(lexeme.isEOF()
+                      ? endOfFileError(nonTerminal)
+                      : parser.nonTerminalError(nonTerminal, lexeme));
+  }
+
+ private:
+  const Parser& parser;
+  Symbols::ID end;  // $
+
+  // terminalOf is indexed by symbol, and terminalSymbols by terminal.
+  std::vector<Terminal> terminalOf;
+  std::vector<Symbols::ID> terminalSymbols;
+  Terminal sigma;  // the terminal of string literals
+
+  // The program being parsed and what is left of the lexeme after the ones
+  // consumed. Words that are not reserved are parsed a character at a time,
+  // so the next lexeme is the first character of such a word, unless a
+  // lexical rule matches more of it.
+  const Lexer::Lines* file = nullptr;
+  Tree* tree = nullptr;
+  FoldStacks folding;
+  Lexer::Lexemes lexemes;
+  Lexer::Lexemes::iterator it;
+  Lexer::Lexeme word;
+  bool consumed = true;  // if all of word was consumed
+  bool partial = false;  // if word is the rest of a word
+  bool isWord = false;   // if word is a word that is not reserved
+  Lexer::Lexeme lexeme;
+  Terminal terminal = END;
+  bool read = false;  // if isWord, lexeme and terminal are up to date
+
+  // advance finds the next lexeme, reading the next one if word was consumed.
+  void advance();
+
+  // consume consumes the first n bytes of word.
+  void consume(size_t n) {
+    if (n == word.value.size()) {
+      consumed = true;
+    } else {
+      shorten(n);
+    }
+    read = false;
+  }
+  void shorten(size_t n);
+
+  SyntaxError failure(std::string message) const {
+    return SyntaxError(*file, lexeme, message);
+  }
 };
@@ -0,0 +1,233 @@
+#include "scan.hpp"
+
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+namespace {
+// The scalar kernels are the reference for the vectorized ones and finish off
+// the last few bytes of a buffer that don't fill a whole vector.
+
+bool isWord(unsigned char c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ||
+         c == '.';
+}
+
+bool isSpace(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+const char* wordScalar(const char* p, const char* end) {
+  while (p < end && isWord(static_cast<unsigned char>(*p))) {
+    p++;
+  }
+  return p;
+}
+
+const char* spaceScalar(const char* p, const char* end) {
+  while (p < end && isSpace(static_cast<unsigned char>(*p))) {
+    p++;
+  }
+  return p;
+}
+
+const char* findScalar(const char* p, const char* end, char c) {
+  while (p < end && *p != c) {
+    p++;
+  }
+  return p;
+}
+
+#ifdef SCAN_X86
+// Each vectorized kernel computes a mask of the bytes that end the run and
+// returns at its lowest set bit. Byte ranges are tested with unsigned
+// saturating subtraction: x is in [lo, hi] exactly when (x - lo) saturating
+// minus (hi - lo) is zero.
+
+__attribute__((target("sse2"))) __m128i inRange(__m128i v, char lo, char hi) {
+  const __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  const __m128i over =
+      _mm_subs_epu8(offset, _mm_set1_epi8(static_cast<char>(hi - lo)));
+  return _mm_cmpeq_epi8(over, _mm_setzero_si128());
+}
+
+__attribute__((target("sse2"))) __m128i wordMask(__m128i v) {
+  const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  return _mm_or_si128(
+      _mm_or_si128(inRange(v, '0', '9'), inRange(lower, 'a', 'z')),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+}
+
+__attribute__((target("sse2"))) __m128i spaceMask(__m128i v) {
+  return _mm_or_si128(inRange(v, '\t', '\r'),
+                      _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("sse2"))) const char* wordSSE2(const char* p,
+                                                     const char* end) {
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const unsigned stop = ~_mm_movemask_epi8(wordMask(v)) & 0xffff;
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return wordScalar(p, end);
+}
+
+__attribute__((target("sse2"))) const char* spaceSSE2(const char* p,
+                                                      const char* end) {
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const unsigned stop = ~_mm_movemask_epi8(spaceMask(v)) & 0xffff;
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return spaceScalar(p, end);
+}
+
+__attribute__((target("sse2"))) const char* findSSE2(const char* p,
+                                                     const char* end, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const unsigned stop = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return findScalar(p, end, c);
+}
+
+__attribute__((target("avx2"))) __m256i inRange(__m256i v, char lo, char hi) {
+  const __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  const __m256i over =
+      _mm256_subs_epu8(offset, _mm256_set1_epi8(static_cast<char>(hi - lo)));
+  return _mm256_cmpeq_epi8(over, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) __m256i wordMask(__m256i v) {
+  const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  return _mm256_or_si256(
+      _mm256_or_si256(inRange(v, '0', '9'), inRange(lower, 'a', 'z')),
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+}
+
+__attribute__((target("avx2"))) __m256i spaceMask(__m256i v) {
+  return _mm256_or_si256(inRange(v, '\t', '\r'),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2"))) const char* wordAVX2(const char* p,
+                                                     const char* end) {
+  for (; end - p >= 32; p += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const unsigned stop =
+        ~static_cast<unsigned>(_mm256_movemask_epi8(wordMask(v)));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return wordSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) const char* spaceAVX2(const char* p,
+                                                      const char* end) {
+  for (; end - p >= 32; p += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const unsigned stop =
+        ~static_cast<unsigned>(_mm256_movemask_epi8(spaceMask(v)));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return spaceSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) const char* findAVX2(const char* p,
+                                                     const char* end, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  for (; end - p >= 32; p += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const unsigned stop = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+    if (stop != 0) {
+      return p + __builtin_ctz(stop);
+    }
+  }
+  return findSSE2(p, end, c);
+}
+#endif
+
+struct kernelSet {
+  std::string_view name;
+  bool (*supported)();
+  const char* (*word)(const char*, const char*);
+  const char* (*space)(const char*, const char*);
+  const char* (*find)(const char*, const char*, char);
+};
+
+// kernelSets lists every kernel set, fastest first.
+const kernelSet kernelSets[] = {
+#ifdef SCAN_X86
+    {"avx2", []() { return __builtin_cpu_supports("avx2") != 0; }, wordAVX2,
+     spaceAVX2, findAVX2},
+    {"sse2", []() { return __builtin_cpu_supports("sse2") != 0; }, wordSSE2,
+     spaceSSE2, findSSE2},
+#endif
+    {"scalar", []() { return true; }, wordScalar, spaceScalar, findScalar},
+};
+
+const kernelSet* detect() {
+#ifdef SCAN_X86
+  // detect runs from a static initializer, possibly before libgcc has set up
+  // the CPU model that __builtin_cpu_supports reads.
+  __builtin_cpu_init();
+#endif
+  for (const auto& set : kernelSets) {
+    if (set.supported()) {
+      return &set;
+    }
+  }
+  return nullptr;  // unreachable, scalar is always supported
+}
+
+const kernelSet* active = detect();
+}  // namespace
+
+const char* Scan::word(const char* p, const char* end) {
+  return active->word(p, end);
+}
+
+const char* Scan::space(const char* p, const char* end) {
+  return active->space(p, end);
+}
+
+const char* Scan::find(const char* p, const char* end, char c) {
+  return active->find(p, end, c);
+}
+
+std::string_view Scan::kernels() { return active->name; }
+
+std::vector<std::string_view> Scan::available() {
+  std::vector<std::string_view> names;
+  for (const auto& set : kernelSets) {
+    if (set.supported()) {
+      names.push_back(set.name);
+    }
+  }
+  return names;
+}
+
+bool Scan::use(std::string_view name) {
+  for (const auto& set : kernelSets) {
+    if (set.name == name && set.supported()) {
+      active = &set;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+// Scan finds the ends of character runs in a buffer. Each function returns a
+// pointer to the first byte in [p, end) that ends the run, or end.
+//
+// The functions use SSE2 or AVX2 kernels when the CPU supports them, which is
+// detected once at startup, and fall back to plain loops otherwise.
+struct Scan {
+  // word skips over alphanumeric characters and '.'.
+  static const char* word(const char* p, const char* end);
+
+  // space skips over whitespace as defined by std::isspace.
+  static const char* space(const char* p, const char* end);
+
+  // find skips to the first occurrence of c.
+  static const char* find(const char* p, const char* end, char c);
+
+  // kernels returns the name of the kernels in use.
+  static std::string_view kernels();
+
+  // available returns the names of the kernels this CPU can run, fastest
+  // first.
+  static std::vector<std::string_view> available();
+
+  // use switches to the kernels with the given name. It returns false if this
+  // CPU cannot run them.
+  static bool use(std::string_view name);
+};
@@ -0,0 +1,58 @@
+#include "symbols.hpp"
+
+#include <array>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+struct symbolTable {
+  std::deque<std::string> names{""};  // indexed by ID, stable addresses
+  std::unordered_map<std::string_view, Symbols::ID> ids;
+  std::array<Symbols::ID, 256> chars{};  // single characters
+};
+
+// table is built on first use, so that grammars loaded by static
+// initializers can intern symbols.
+symbolTable& table() {
+  static symbolTable t;
+  return t;
+}
+}  // namespace
+
+Symbols::ID Symbols::intern(std::string_view name) {
+  const ID found = find(name);
+  if (found != NONE || name.empty()) {
+    return found;
+  }
+
+  auto& t = table();
+  const ID id = t.names.size();
+  const std::string_view stored = t.names.emplace_back(name);
+  t.ids.emplace(stored, id);
+  if (stored.size() == 1) {
+    t.chars[static_cast<unsigned char>(stored[0])] = id;
+  }
+  return id;
+}
+
+Symbols::ID Symbols::find(std::string_view name) {
+  const auto& t = table();
+  if (name.size() == 1) {
+    return t.chars[static_cast<unsigned char>(name[0])];
+  }
+  const auto it = t.ids.find(name);
+  return it == t.ids.end() ? NONE : it->second;
+}
+
+std::string_view Symbols::name(ID id) {
+  const auto& t = table();
+  if (id >= t.names.size()) {
+    throw std::out_of_range("Symbols::name: unknown symbol");
+  }
+  return t.names[id];
+}
+
+size_t Symbols::size() { return table().names.size(); }
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Symbols interns the terminals and non-terminals of grammars as 32-bit IDs,
+// so that the parser and everything after it compare integers instead of
+// strings. An ID never changes once its name is interned.
+//
+// Looking symbols up is safe from multiple threads, but interning is not safe
+// while anything else uses the symbols. Grammars intern their symbols when
+// they are loaded, which should be done before lexing anything that they will
+// parse, since lexemes are looked up when they are lexed.
+struct Symbols {
+  typedef uint32_t ID;
+
+  // NONE is the ID of every name that was never interned.
+  static constexpr ID NONE = 0;
+
+  // intern returns the ID of the given name, interning it if it is new.
+  static ID intern(std::string_view name);
+
+  // find returns the ID of the given name, or NONE if it was never interned.
+  // Single characters are looked up in a table instead of being hashed.
+  static ID find(std::string_view name);
+
+  // name returns the name of the given symbol, which lives forever. The name
+  // of NONE is empty.
+  static std::string_view name(ID id);
+
+  // size returns one past the largest ID.
+  static size_t size();
+};
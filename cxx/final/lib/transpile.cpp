@@ -6,15 +6,34 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "symbols.hpp"
+
 const std::unordered_map<std::string, std::string> typeMap{
     {"integer", "int"},
 };
 
+// grammarSymbols holds the symbols of the non-terminals the transpiler knows,
+// which the grammar interned when it was loaded.
+struct grammarSymbols {
+  Symbols::ID prog = Symbols::find("<prog>");
+  Symbols::ID decList = Symbols::find("<dec-list>");
+  Symbols::ID dec = Symbols::find("<dec>");
+  Symbols::ID type = Symbols::find("<type>");
+  Symbols::ID statList = Symbols::find("<stat-list>");
+  Symbols::ID stat = Symbols::find("<stat>");
+  Symbols::ID write = Symbols::find("<write>");
+  Symbols::ID writePrime = Symbols::find("<write-prime>");
+  Symbols::ID assign = Symbols::find("<assign>");
+  Symbols::ID expr = Symbols::find("<expr>");
+  Symbols::ID factor = Symbols::find("<factor>");
+};
+
 class ctranspiler {
  private:
   std::ostream& out;
   const Parser::Program& program;
 
+  const grammarSymbols symbols;
   std::unordered_set<std::string> variables;
 
   void addVariable(const Parser::Token& id) {
@@ -44,7 +63,7 @@ class ctranspiler {
       return;  // base case
     }
 
-    if (token.type == "<prog>") {
+    if (token.type == symbols.prog) {
       out << "#include <iostream>\n"
           << "\n"
           << "int main() {\n";
@@ -57,9 +76,9 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<dec-list>") {
-      const auto type = token.children.at(2).getToken();  // <type>
-      const auto dec = token.children.at(0).getToken();   // <dec>
+    if (token.type == symbols.decList) {
+      const auto& type = token.children.at(2).getToken();  // <type>
+      const auto& dec = token.children.at(0).getToken();   // <dec>
 
       out << "  ";
       walk(type);
@@ -70,29 +89,22 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<dec>") {
-      const auto identifier = token.children.at(0).getToken();  // <identifier>
-      const auto prime = token.children.at(1).getToken();       // <dec-prime>
-      addVariable(identifier);
-
-      out << identifier.extractLiterals();
-      walk(prime);
-
-      return;
-    }
-
-    if (token.type == "<dec-prime>") {
-      const auto identifier = token.children.at(1).getToken();  // <identifier>
-      const auto prime = token.children.at(2).getToken();       // <dec-prime>
-      addVariable(identifier);
-
-      out << ", " << identifier.extractLiterals();
-      walk(prime);
+    if (token.type == symbols.dec) {
+      // <identifier> { , <identifier> }
+      for (const auto& child : token.children) {
+        if (child.type == Parser::Token::Value::LITERAL) {
+          out << ", ";
+          continue;
+        }
+        const auto& identifier = child.getToken();
+        addVariable(identifier);
+        out << identifier.extractLiterals();
+      }
 
       return;
     }
 
-    if (token.type == "<type>") {
+    if (token.type == symbols.type) {
       const auto ourType = token.extractLiterals();
       const auto cxxType = typeMap.at(ourType);
       out << cxxType;
@@ -100,18 +112,17 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<stat-list>" || token.type == "<stat-list-prime>") {
-      const auto stat = token.children.at(0).getToken();   // <stat>
-      const auto prime = token.children.at(1).getToken();  // <stat-list-prime>
-
-      walk(stat);
-      walk(prime);
+    if (token.type == symbols.statList) {
+      for (const auto& stat : token.children) {
+        walk(stat.getToken());  // <stat>
+      }
 
       return;
     }
 
-    if (token.type == "<stat>") {
-      const auto child = token.children.at(0).getToken();  // <write> | <assign>
+    if (token.type == symbols.stat) {
+      const auto& child =
+          token.children.at(0).getToken();  // <write> | <assign>
 
       out << "  ";
       walk(child);
@@ -120,8 +131,8 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<write>") {
-      const auto prime = token.children.at(2).getToken();  // <write-prime>
+    if (token.type == symbols.write) {
+      const auto& prime = token.children.at(2).getToken();  // <write-prime>
 
       out << "std::cout";
       walk(prime);
@@ -130,14 +141,14 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<write-prime>") {
+    if (token.type == symbols.writePrime) {
       if (token.children.size() == 3) {
         const auto string = token.children.at(0).getLiteral();  // σ
-        const auto identifier =
+        const auto& identifier =
             token.children.at(2).getToken();  // <identifier>
         out << " << " << string << " << " << identifier.extractLiterals();
       } else {
-        const auto identifier =
+        const auto& identifier =
             token.children.at(0).getToken();  // <identifier>
         out << " << " << identifier.extractLiterals();
       }
@@ -145,9 +156,11 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<assign>") {
-      const auto identifier = token.children.at(0).getToken();  // <identifier>
-      const auto expression = token.children.at(2).getToken();  // <expr>
+    if (token.type == symbols.assign) {
+      const auto& identifier =
+          token.children.at(0).getToken();  // <identifier>
+      const auto& expression =
+          token.children.at(2).getToken();  // <expr>
 
       assertVariable(identifier);
 
@@ -157,65 +170,35 @@ class ctranspiler {
       return;
     }
 
-    if (token.type == "<expr>") {
-      const auto term = token.children.at(0).getToken();   // <term>
-      const auto prime = token.children.at(1).getToken();  // <expr-prime>
-
-      walk(term);
-      walk(prime);
-
-      return;
-    }
-
-    if (token.type == "<expr-prime>") {
-      const auto op = token.children.at(0).getLiteral();
-      const auto term = token.children.at(1).getToken();   // <term>
-      const auto prime = token.children.at(2).getToken();  // <expr-prime>
-
-      out << " " << op << " ";
-      walk(term);
-      walk(prime);
-
-      return;
-    }
-
-    if (token.type == "<term>") {
-      const auto factor = token.children.at(0).getToken();  // <factor>
-      const auto prime = token.children.at(1).getToken();   // <term-prime>
-
-      walk(factor);
-      walk(prime);
-
-      return;
-    }
-
-    if (token.type == "<term-prime>") {
-      const auto op = token.children.at(0).getLiteral();
-      const auto factor = token.children.at(1).getToken();  // <factor>
-      const auto prime = token.children.at(2).getToken();   // <term-prime>
-
-      out << " " << op << " ";
-      walk(factor);
-      walk(prime);
+    if (token.type == symbols.expr) {
+      // <factor>, or <expr> or <factor>, an operator and <expr> or <factor>
+      for (const auto& child : token.children) {
+        if (child.type == Parser::Token::Value::LITERAL) {
+          out << " " << child.getLiteral() << " ";
+        } else {
+          walk(child.getToken());
+        }
+      }
 
       return;
     }
 
-    if (token.type == "<factor>") {
+    if (token.type == symbols.factor) {
       if (token.children.size() == 3) {
-        const auto expr = token.children.at(1).getToken();  // <expr>
+        const auto& expr = token.children.at(1).getToken();  // <expr>
         out << "(";
         walk(expr);
         out << ")";
       } else {
-        const auto child = token.children.at(0).getToken();
+        const auto& child = token.children.at(0).getToken();
         out << child.extractLiterals();
       }
 
       return;
     }
 
-    throw std::runtime_error("Unknown token type: " + token.type);
+    throw std::runtime_error("Unknown token type: " +
+                             std::string(Symbols::name(token.type)));
   }
 };
 
@@ -229,7 +212,7 @@ std::string CTranspiler::TranspileError::formatError(
     std::string message) {
   std::stringstream ss;
   ss << "transpile error at token " << std::quoted(token.extractLiterals())
-     << " " << token.type << ": " << message
-     << formatLine(program.file, token.location());
+     << " " << Symbols::name(token.type) << ": " << message
+     << formatLine(program.file(), token.location());
   return ss.str();
 }
@@ -14,7 +14,7 @@ struct CTranspiler {
 class CTranspiler::TranspileError : public std::runtime_error {
  public:
   const Parser::Program& program;  // the entire program
-  const Parser::Token& token;      // where the error occurred
+  const Parser::Token token;       // where the error occurred
 
   TranspileError(const Parser::Program& program, const Parser::Token& token,
                  std::string message)
@@ -1,36 +1,67 @@
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <system_error>
+#include <thread>
 
+#include "builtin.hpp"
 #include "lib/grammar.hpp"
 #include "lib/lexer.hpp"
 #include "lib/parser.hpp"
 #include "lib/transpile.hpp"
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
-    std::cerr << "usage: " << argv[0] << " program_file" << std::endl;
+  if (argc != 2 && argc != 4) {
+    std::cerr << "usage: " << argv[0]
+              << " program_file [grammar_file error_entries_file]"
+              << std::endl;
     return 1;
   }
 
   std::string inputPath = argv[1];
 
-  std::ifstream in(inputPath);
-  if (!in) {
+  std::shared_ptr<Lexer::Source> source;
+  try {
+    source = Lexer::Source::map(inputPath);
+  } catch (const std::system_error&) {
     std::cerr << "error: could not open file " << argv[1] << std::endl;
     return 1;
   }
 
-  auto file = Lexer::lex(in);
-  file = file.removeComments();
+  // The grammar interns its symbols, which lexemes are tagged with as they
+  // are lexed, so it has to be loaded first. It is compiled in from
+  // grammar.txt, unless another one is given, which is processed once and
+  // then loaded from a cache file next to it.
+  std::optional<Grammar> grammar;
+  std::string errorEntriesText(builtin::errorEntries);
+  if (argc == 4) {
+    for (const char* path : {argv[2], argv[3]}) {
+      if (!std::ifstream(path)) {
+        std::cerr << "error: could not open file " << path << std::endl;
+        return 1;
+      }
+    }
+    grammar.emplace(std::string(argv[2]), std::string(argv[2]) + ".cache");
+    std::ifstream errorEntriesFile(argv[3]);
+    std::stringstream text;
+    text << errorEntriesFile.rdbuf();
+    errorEntriesText = text.str();
+  } else {
+    grammar.emplace(builtin::grammar);
+  }
+
+  auto file = Lexer::lexParallel(source, std::thread::hardware_concurrency(),
+                                 Lexer::SKIP_COMMENTS);
 
   std::ofstream stage1(inputPath + ".1.txt");
   stage1 << file << std::endl;
   stage1.close();
 
-  Grammar grammar("grammar.txt");
-
-  Parser parser(grammar);
-  parser.loadErrorEntries("error-entry-messages.txt");
+  Parser parser(*grammar);
+  std::istringstream errorEntries{errorEntriesText};
+  parser.loadErrorEntries(errorEntries);
 
   Parser::Program program = parser.parse(file);
 
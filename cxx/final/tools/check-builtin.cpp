@@ -0,0 +1,106 @@
+// check-builtin checks that the grammar and error entry messages compiled into
+// builtin.hpp match the ones loaded from their files at runtime:
+//
+//   check-builtin grammar.txt error-entry-messages.txt
+//
+// It exits with 1 and prints the differences if they do not.
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../builtin.hpp"
+#include "../lib/grammar.hpp"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "builtin differs: " << what << std::endl;
+    failures++;
+  }
+}
+
+// printed returns everything the grammar prints.
+std::string printed(const Grammar& grammar) {
+  std::stringstream out;
+  auto* const err = std::cerr.rdbuf(out.rdbuf());
+  grammar.printGrammar();
+  grammar.printMembersOfFirst();
+  grammar.printMembersOfFollow();
+  grammar.printPredictiveParsingTable();
+  std::cerr.rdbuf(err);
+  return out.str();
+}
+
+// cells returns what every cell of the compiled table expands to.
+std::vector<std::vector<Symbols::ID>> cells(const Grammar& grammar,
+                                            Grammar::TableLayout layout) {
+  const auto table = grammar.compileParsingTable(layout);
+  std::vector<std::string> terminals(grammar.getTerminals().begin(),
+                                     grammar.getTerminals().end());
+  terminals.push_back("$");
+
+  std::vector<std::vector<Symbols::ID>> cells;
+  for (const auto& nonTerminal : grammar.getNonTerminals()) {
+    for (const auto& terminal : terminals) {
+      const auto production =
+          table.lookup(Symbols::find(nonTerminal), Symbols::find(terminal));
+      auto& cell = cells.emplace_back();
+      if (production != Grammar::CompiledTable::ERROR) {
+        const auto right = table.rightSide(production);
+        cell.assign(right.begin(), right.end());
+      }
+    }
+  }
+  return cells;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " grammar_file error_entries_file"
+              << std::endl;
+    return 1;
+  }
+
+  const Grammar runtime{std::string(argv[1])};
+  const Grammar builtin(builtin::grammar);
+
+  const auto want = runtime.exportTables();
+  const auto got = builtin.exportTables();
+  check(want.nonTerminals == got.nonTerminals, "non-terminals");
+  check(want.terminals == got.terminals, "terminals");
+  check(want.grammarTerminals == got.grammarTerminals, "grammar terminals");
+  check(want.groups == got.groups, "groups");
+  check(want.operators == got.operators, "operators");
+  check(want.lefts == got.lefts && want.starts == got.starts &&
+            want.rights == got.rights,
+        "grammar entries");
+  check(want.nullable == got.nullable, "nullable non-terminals");
+  check(want.first == got.first, "members of first");
+  check(want.follow == got.follow, "members of follow");
+  check(want.offsets == got.offsets && want.checks == got.checks &&
+            want.cells == got.cells,
+        "compiled parsing table");
+
+  check(printed(runtime) == printed(builtin), "printed grammar");
+  for (const auto layout : {Grammar::AUTO, Grammar::DENSE, Grammar::COMB}) {
+    check(cells(runtime, layout) == cells(builtin, layout),
+          "compiled parsing table cells");
+  }
+
+  std::ifstream errorsFile(argv[2]);
+  std::stringstream errors;
+  errors << errorsFile.rdbuf();
+  check(errors.str() == builtin::errorEntries, "error entries");
+
+  if (failures > 0) {
+    return 1;
+  }
+  std::cout << "builtin matches " << argv[1] << " and " << argv[2]
+            << std::endl;
+}
@@ -0,0 +1,140 @@
+// check-truncated checks that every way of parsing a program reports a syntax
+// error for each prefix of it that ends before its last lexeme, instead of
+// parsing as much as there is and accepting it:
+//
+//   check-truncated grammar.txt program.txt
+//
+// The whole program has to parse without errors. Prefixes that cannot be
+// lexed, such as those that end in a comment, are skipped. It exits with 1 and
+// prints the prefixes that were accepted if there are any.
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../descent.hpp"
+#include "../lib/grammar.hpp"
+#include "../lib/lexer.hpp"
+#include "../lib/parser.hpp"
+
+namespace {
+int failures = 0;
+
+void check(bool ok, size_t length, const std::string& what) {
+  if (!ok) {
+    std::cerr << "prefix of " << length << " bytes: " << what << std::endl;
+    failures++;
+  }
+}
+
+// fails returns the message of the SyntaxError that parse throws, or an empty
+// string if it throws none.
+std::string fails(std::function<void()> parse) {
+  try {
+    parse();
+  } catch (const Parser::SyntaxError& error) {
+    return error.what();
+  }
+  return "";
+}
+
+// exits records whether the listened parse exited the given non-terminal,
+// which is the last thing a parse of a whole program does.
+class exits : public Parser::ParseListener {
+ public:
+  explicit exits(Symbols::ID nonTerminal) : nonTerminal(nonTerminal) {}
+
+  void exitNonTerminal(Symbols::ID exited) override {
+    exited_ |= exited == nonTerminal;
+  }
+
+  bool exited() const { return exited_; }
+
+ private:
+  Symbols::ID nonTerminal;
+  bool exited_ = false;
+};
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " grammar_file program_file"
+              << std::endl;
+    return 1;
+  }
+
+  const Grammar grammar{std::string(argv[1])};
+  const Parser parser(grammar);
+  DescentParser descent(parser);
+  const Symbols::ID start = Symbols::find(grammar.getStartingGrammar().first);
+
+  std::ifstream programFile(argv[2]);
+  if (!programFile) {
+    std::cerr << "error: could not open " << argv[2] << std::endl;
+    return 1;
+  }
+  std::stringstream read;
+  read << programFile.rdbuf();
+  const std::string program = read.str();
+
+  const auto whole =
+      Lexer::lex(Lexer::Source::borrow(program)).removeComments();
+  const auto lexemes = whole.flatten();
+  if (lexemes.empty() || !parser.parseAll(whole).errors.empty()) {
+    std::cerr << "error: " << argv[2] << " is not a program" << std::endl;
+    return 1;
+  }
+  const size_t last = lexemes[lexemes.size() - 1].loc.end;
+
+  size_t checked = 0;
+  for (size_t length = 1; length < last; length++) {
+    const std::string_view prefix(program.data(), length);
+    const auto source = Lexer::Source::borrow(prefix);
+    Lexer::Lines lines;
+    try {
+      lines = Lexer::lex(source).removeComments();
+    } catch (const std::runtime_error&) {
+      continue;
+    }
+    if (lines.empty()) {
+      continue;
+    }
+    checked++;
+
+    const std::string error = fails([&]() { parser.parse(lines); });
+    check(!error.empty(), length, "parse accepted it");
+    check(fails([&]() { descent.parse(lines); }) == error, length,
+          "the descent parser failed differently");
+    check(fails([&]() {
+            Lexer::TokenStream stream(source, Lexer::SKIP_COMMENTS);
+            parser.parse(stream);
+          }) == error,
+          length, "parsing a stream failed differently");
+    check(!parser.parseAll(lines).errors.empty(), length,
+          "parseAll recorded no error");
+
+    // A listener is never told that the program was parsed.
+    exits listened(start);
+    check(fails([&]() { parser.parse(lines, listened); }) == error, length,
+          "parsing with a listener failed differently");
+    exits streamed(start);
+    check(fails([&]() {
+            Lexer::TokenStream stream(source, Lexer::SKIP_COMMENTS);
+            parser.parse(stream, streamed);
+          }) == error,
+          length, "parsing a stream with a listener failed differently");
+    exits recovered(start);
+    check(!parser.parseAll(lines, recovered).empty(), length,
+          "parseAll with a listener recorded no error");
+    check(!listened.exited() && !streamed.exited() && !recovered.exited(),
+          length, "a listener was told the program was parsed");
+  }
+
+  if (failures > 0) {
+    return 1;
+  }
+  std::cout << "every parse rejects the " << checked
+            << " truncated prefixes of " << argv[2] << std::endl;
+}
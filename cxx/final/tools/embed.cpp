@@ -0,0 +1,129 @@
+// embed writes a header that compiles a grammar and its error entry messages
+// into a program as constexpr arrays, so that the program can build its parser
+// without reading or processing them:
+//
+//   embed grammar.txt error-entry-messages.txt > builtin.hpp
+//
+// The header defines builtin::grammar, which is passed to Grammar's
+// constructor, and builtin::errorEntries, which is the text of the error entry
+// messages.
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "../lib/grammar.hpp"
+#include "quote.hpp"
+
+namespace {
+// writeArray writes a constexpr std::array of the given values, wrapped to 80
+// columns.
+template <class T, class F>
+void writeArray(std::ostream& out, const std::string& type,
+                const std::string& name, std::span<const T> values,
+                F format) {
+  out << "constexpr std::array<" << type << ", " << values.size() << "> "
+      << name << " = {";
+  size_t column = 80;
+  for (size_t i = 0; i < values.size(); i++) {
+    const std::string value =
+        format(values[i]) + (i + 1 < values.size() ? "," : "");
+    if (column + 1 + value.size() > 80) {
+      out << "\n   ";
+      column = 3;
+    }
+    out << ' ' << value;
+    column += 1 + value.size();
+  }
+  out << (values.empty() ? "};\n\n" : "\n};\n\n");
+}
+
+template <class T>
+void writeNumbers(std::ostream& out, const std::string& type,
+                  const std::string& name, std::span<const T> values) {
+  writeArray(out, type, name, values, [](T value) {
+    return std::to_string(value) + (sizeof(T) == 8 ? "u" : "");
+  });
+}
+
+void writeStrings(std::ostream& out, const std::string& name,
+                  std::span<const std::string_view> values) {
+  writeArray(out, "std::string_view", name, values, quote);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " grammar_file error_entries_file"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream grammarFile(argv[1]);
+  std::ifstream errorsFile(argv[2]);
+  if (!grammarFile || !errorsFile) {
+    std::cerr << "error: could not open " << (grammarFile ? argv[2] : argv[1])
+              << std::endl;
+    return 1;
+  }
+  std::stringstream errors;
+  errors << errorsFile.rdbuf();
+
+  const Grammar grammar(grammarFile);
+  const auto tables = grammar.exportTables();
+
+  auto& out = std::cout;
+  out << "// Code generated by tools/embed.cpp from " << argv[1] << " and\n"
+      << "// " << argv[2] << ". DO NOT EDIT.\n\n"
+      << "#pragma once\n\n"
+      << "#include <array>\n"
+      << "#include <cstdint>\n"
+      << "#include <string_view>\n\n"
+      << "#include \"lib/grammar.hpp\"\n\n"
+      << "namespace builtin {\n"
+      << "namespace tables {\n";
+  // The order of the arrays is the order of the members of Grammar::Tables.
+  writeStrings(out, "nonTerminals", tables.nonTerminals);
+  writeStrings(out, "terminals", tables.terminals);
+  writeNumbers<uint32_t>(out, "uint32_t", "grammarTerminals",
+                         tables.grammarTerminals);
+  writeNumbers<uint32_t>(out, "uint32_t", "groups", tables.groups);
+  writeNumbers<uint32_t>(out, "uint32_t", "operators", tables.operators);
+  writeNumbers<uint32_t>(out, "uint32_t", "lefts", tables.lefts);
+  writeNumbers<uint32_t>(out, "uint32_t", "starts", tables.starts);
+  writeNumbers<uint32_t>(out, "uint32_t", "rights", tables.rights);
+  writeNumbers<uint64_t>(out, "uint64_t", "nullable", tables.nullable);
+  writeNumbers<uint64_t>(out, "uint64_t", "first", tables.first);
+  writeNumbers<uint64_t>(out, "uint64_t", "follow", tables.follow);
+  writeNumbers<uint64_t>(out, "uint64_t", "offsets", tables.offsets);
+  writeNumbers<uint32_t>(out, "uint32_t", "checks", tables.checks);
+  writeNumbers<Grammar::CompiledTable::Production>(out, "uint16_t", "cells",
+                                                   tables.cells);
+  out << "}  // namespace tables\n\n"
+      << "// grammar is the tables of " << argv[1] << ".\n"
+      << "constexpr Grammar::Tables grammar = {\n";
+  for (const auto name : {"nonTerminals", "terminals", "grammarTerminals",
+                           "groups", "operators", "lefts", "starts", "rights",
+                           "nullable", "first", "follow", "offsets", "checks",
+                           "cells"}) {
+    out << "    tables::" << name << ",\n";
+  }
+  out << "};\n\n"
+      << "// errorEntries is the text of " << argv[2] << ".\n"
+      << "constexpr std::string_view errorEntries =";
+
+  std::string line;
+  bool any = false;
+  while (std::getline(errors, line)) {
+    if (!errors.eof()) {
+      line += '\n';
+    }
+    out << "\n    " << quote(line);
+    any = true;
+  }
+  out << (any ? ";\n" : " \"\";\n") << "}  // namespace builtin\n";
+}
@@ -0,0 +1,558 @@
+// generate-lr writes the LALR(1) parsing table of a grammar in the CSV format
+// that the LR driver of handout-08 (LRExpressionParser) reads:
+//
+//   generate-lr grammar.txt lrtable.csv rules.csv
+//
+// From ../handout-08/grammar.txt it writes the tables that handout-08 comes
+// with, up to the order of their columns.
+//
+// The grammar is read like any other, so it may use groups, but it is not
+// required to be LL(1): left recursion is what LR parsers are made for. The
+// grammar is augmented with a start that derives the starting non-terminal,
+// the canonical LR(0) item sets are built from it, and their lookaheads are
+// computed by propagating them between kernel items as in the Dragon Book.
+//
+// Every shift/reduce and reduce/reduce conflict is reported, and no tables are
+// written if there are any. The driver reads one character per terminal and
+// pops a character of the right side of a rule per symbol, so every symbol of
+// a grammar entry must be one character once non-terminals lose their < and >,
+// and no grammar entry may derive λ.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../lib/bitset.hpp"
+#include "../lib/grammar.hpp"
+
+namespace {
+// Item is an LR(0) item: a grammar entry with a dot before one of the symbols
+// of its right side, or at its end.
+struct Item {
+  uint32_t production;
+  uint32_t dot;
+
+  auto operator<=>(const Item&) const = default;
+};
+
+// Action is a cell of the action table.
+struct Action {
+  enum Kind { ERROR, SHIFT, REDUCE, ACCEPT };
+  Kind kind = ERROR;
+  uint32_t value = 0;  // the state to shift to or the production to reduce by
+};
+
+class automaton {
+ public:
+  // Symbols are numbered like in Grammar::Tables, except that the augmented
+  // start is the non-terminal after the others, and λ is left out.
+  explicit automaton(const Grammar::OwnedTables& tables)
+      : tables(tables),
+        nonTerminals(tables.nonTerminals.size() + 1),
+        terminals(tables.terminals.size()),
+        start(static_cast<uint32_t>(tables.nonTerminals.size())),
+        productionsOf(nonTerminals) {
+    for (size_t p = 0; p < tables.lefts.size(); p++) {
+      auto& production = productions.emplace_back();
+      production.left = tables.lefts[p];
+      for (uint32_t i = tables.starts[p]; i < tables.starts[p + 1]; i++) {
+        const uint32_t symbol = tables.rights[i];
+        if (symbol < start ||
+            tables.terminals[symbol - start] != std::string_view(LAMBDA)) {
+          production.right.push_back(symbol < start ? symbol : symbol + 1);
+        }
+      }
+    }
+    productions.push_back({start, {tables.lefts[0]}});
+    for (uint32_t p = 0; p < productions.size(); p++) {
+      productionsOf[productions[p].left].push_back(p);
+    }
+    end = static_cast<uint32_t>(
+        std::find(tables.terminals.begin(), tables.terminals.end(), "$") -
+        tables.terminals.begin());
+
+    findMembersOfFirst();
+    buildItemSets();
+    findLookaheads();
+    buildActions();
+  }
+
+  struct State {
+    std::vector<Item> kernel;
+    std::vector<Bitset> lookaheads;  // of each kernel item, by terminal
+    std::vector<std::pair<uint32_t, uint32_t>> transitions;  // symbol, state
+  };
+
+  struct Production {
+    uint32_t left;
+    std::vector<uint32_t> right;
+  };
+
+  const Grammar::OwnedTables& tables;
+  const uint32_t nonTerminals;  // with the augmented start
+  const uint32_t terminals;     // with $ and λ
+  const uint32_t start;         // the augmented start
+  uint32_t end = 0;             // the terminal $
+
+  std::vector<Production> productions;  // the augmented start's is last
+  std::vector<std::vector<uint32_t>> productionsOf;
+  std::vector<State> states;
+
+  // The action of each state on each terminal, and the state each one goes
+  // to on each non-terminal, or NONE.
+  std::vector<std::vector<Action>> actions;
+  std::vector<std::vector<uint32_t>> gotos;
+  std::vector<std::string> conflicts;
+
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  bool isNonTerminal(uint32_t symbol) const { return symbol < nonTerminals; }
+
+  // symbolName returns the name of a symbol numbered like in the automaton.
+  std::string symbolName(uint32_t symbol) const {
+    if (symbol == start) {
+      return "<start>";
+    }
+    return std::string(isNonTerminal(symbol)
+                           ? tables.nonTerminals[symbol]
+                           : tables.terminals[terminal(symbol)]);
+  }
+
+  // terminal returns the number of a terminal symbol among the terminals.
+  uint32_t terminal(uint32_t symbol) const { return symbol - nonTerminals; }
+
+  std::string describe(uint32_t production) const {
+    std::string text = symbolName(productions[production].left) + " ->";
+    for (const auto symbol : productions[production].right) {
+      text += " " + symbolName(symbol);
+    }
+    return productions[production].right.empty() ? text + " " + LAMBDA : text;
+  }
+
+ private:
+  // PROPAGATE is the terminal that stands for the lookaheads of the kernel
+  // item a closure is computed from, one past the real ones.
+  uint32_t propagate() const { return terminals; }
+
+  Bitset nullable;
+  std::vector<Bitset> firstMembers;
+
+  void findMembersOfFirst() {
+    nullable = Bitset(nonTerminals);
+    firstMembers.assign(nonTerminals, Bitset(terminals + 1));
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (const auto& production : productions) {
+        Bitset first(terminals + 1);
+        if (addFirst(production.right, 0, first) &&
+            nullable.set(production.left)) {
+          changed = true;
+        }
+        changed |= firstMembers[production.left].merge(first);
+      }
+    }
+  }
+
+  // addFirst adds the members of first of right[from:] to first and returns if
+  // it is nullable.
+  bool addFirst(const std::vector<uint32_t>& right, size_t from,
+                Bitset& first) const {
+    for (size_t i = from; i < right.size(); i++) {
+      if (!isNonTerminal(right[i])) {
+        first.set(terminal(right[i]));
+        return false;
+      }
+      first.merge(firstMembers[right[i]]);
+      if (!nullable.test(right[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // closure returns the kernel items followed by the items of every grammar
+  // entry of a non-terminal after a dot, with the dot at its start.
+  std::vector<Item> closure(const std::vector<Item>& kernel) const {
+    std::vector<Item> items = kernel;
+    Bitset added(nonTerminals);
+    for (size_t i = 0; i < items.size(); i++) {
+      const auto& right = productions[items[i].production].right;
+      if (items[i].dot < right.size() && isNonTerminal(right[items[i].dot]) &&
+          added.set(right[items[i].dot])) {
+        for (const auto p : productionsOf[right[items[i].dot]]) {
+          items.push_back({p, 0});
+        }
+      }
+    }
+    return items;
+  }
+
+  // buildItemSets builds the canonical LR(0) item sets, numbering the states
+  // in the order they are reached, and each state's transitions in the order
+  // of their symbols.
+  void buildItemSets() {
+    std::map<std::vector<Item>, uint32_t> stateOf;
+    states.push_back(
+        {{{static_cast<uint32_t>(productions.size() - 1), 0}}, {}, {}});
+    stateOf[states[0].kernel] = 0;
+    for (size_t s = 0; s < states.size(); s++) {
+      std::map<uint32_t, std::vector<Item>> kernels;
+      for (const auto item : closure(states[s].kernel)) {
+        const auto& right = productions[item.production].right;
+        if (item.dot < right.size()) {
+          kernels[right[item.dot]].push_back({item.production, item.dot + 1});
+        }
+      }
+      for (auto& [symbol, kernel] : kernels) {
+        std::sort(kernel.begin(), kernel.end());
+        const auto [it, added] =
+            stateOf.emplace(kernel, static_cast<uint32_t>(states.size()));
+        if (added) {
+          states.push_back({kernel, {}, {}});
+        }
+        states[s].transitions.emplace_back(symbol, it->second);
+      }
+    }
+  }
+
+  uint32_t transition(uint32_t state, uint32_t symbol) const {
+    const auto& transitions = states[state].transitions;
+    return std::lower_bound(transitions.begin(), transitions.end(),
+                            std::pair(symbol, uint32_t(0)))
+        ->second;
+  }
+
+  // closeLookaheads computes the lookaheads of the items of a closure, given
+  // those of its kernel items. Every item of a non-terminal with the dot at
+  // the start has the same lookaheads, so they are computed per non-terminal,
+  // and reached holds the non-terminals whose items are in the closure.
+  void closeLookaheads(const std::vector<Item>& kernel,
+                       const std::vector<Bitset>& kernelLookaheads,
+                       std::vector<Bitset>& lookaheads, Bitset& reached) const {
+    lookaheads.assign(nonTerminals, Bitset(terminals + 1));
+    reached = Bitset(nonTerminals);
+    std::vector<uint32_t> work;
+    const auto spread = [&](Item item, const Bitset& from) {
+      const auto& right = productions[item.production].right;
+      if (item.dot >= right.size() || !isNonTerminal(right[item.dot])) {
+        return;
+      }
+      Bitset added(terminals + 1);
+      if (addFirst(right, item.dot + 1, added)) {
+        added.merge(from);
+      }
+      const uint32_t next = right[item.dot];
+      if (lookaheads[next].merge(added) | reached.set(next)) {
+        work.push_back(next);
+      }
+    };
+
+    for (size_t k = 0; k < kernel.size(); k++) {
+      spread(kernel[k], kernelLookaheads[k]);
+    }
+    while (!work.empty()) {
+      const uint32_t nonTerminal = work.back();
+      work.pop_back();
+      const Bitset from = lookaheads[nonTerminal];
+      for (const auto p : productionsOf[nonTerminal]) {
+        spread({p, 0}, from);
+      }
+    }
+  }
+
+  // findLookaheads finds the lookaheads of every kernel item. The closure of
+  // each kernel item alone, with PROPAGATE as its lookahead, shows which
+  // lookaheads the items it leads to get from it and which they get
+  // regardless; the ones they get from it are then propagated until nothing
+  // changes.
+  void findLookaheads() {
+    // Kernel items are numbered in order of their states.
+    std::vector<uint32_t> firstItem;
+    uint32_t items = 0;
+    for (auto& state : states) {
+      firstItem.push_back(items);
+      items += static_cast<uint32_t>(state.kernel.size());
+      state.lookaheads.assign(state.kernel.size(), Bitset(terminals + 1));
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> kernelItems;  // state, index
+    for (uint32_t s = 0; s < states.size(); s++) {
+      for (uint32_t k = 0; k < states[s].kernel.size(); k++) {
+        kernelItems.emplace_back(s, k);
+      }
+    }
+
+    std::vector<std::vector<uint32_t>> propagatesTo(items);
+    std::vector<Bitset> lookaheads;
+    Bitset reached;
+    for (uint32_t s = 0; s < states.size(); s++) {
+      for (uint32_t k = 0; k < states[s].kernel.size(); k++) {
+        std::vector<Bitset> own(1, Bitset(terminals + 1));
+        own[0].set(propagate());
+        const Item item = states[s].kernel[k];
+        closeLookaheads({item}, own, lookaheads, reached);
+
+        const auto lead = [&](Item from, const Bitset& lookahead) {
+          const auto& right = productions[from.production].right;
+          if (from.dot >= right.size()) {
+            return;
+          }
+          const uint32_t to = transition(s, right[from.dot]);
+          const auto& kernel = states[to].kernel;
+          const uint32_t index = static_cast<uint32_t>(
+              std::lower_bound(kernel.begin(), kernel.end(),
+                               Item{from.production, from.dot + 1}) -
+              kernel.begin());
+          Bitset spontaneous = lookahead;
+          if (lookahead.test(propagate())) {
+            propagatesTo[firstItem[s] + k].push_back(firstItem[to] + index);
+            spontaneous = Bitset(terminals + 1);
+            lookahead.forEach([&](size_t t) {
+              if (t != propagate()) {
+                spontaneous.set(t);
+              }
+            });
+          }
+          states[to].lookaheads[index].merge(spontaneous);
+        };
+        lead(item, own[0]);
+        reached.forEach([&](size_t nonTerminal) {
+          for (const auto p : productionsOf[nonTerminal]) {
+            lead({p, 0}, lookaheads[nonTerminal]);
+          }
+        });
+      }
+    }
+
+    states[0].lookaheads[0].set(end);
+    std::vector<uint32_t> work(items);
+    for (uint32_t i = 0; i < items; i++) {
+      work[i] = i;
+    }
+    while (!work.empty()) {
+      const uint32_t from = work.back();
+      work.pop_back();
+      const auto [s, k] = kernelItems[from];
+      for (const auto to : propagatesTo[from]) {
+        const auto [toState, toIndex] = kernelItems[to];
+        if (states[toState].lookaheads[toIndex].merge(
+                states[s].lookaheads[k])) {
+          work.push_back(to);
+        }
+      }
+    }
+  }
+
+  // setAction fills in a cell of the action table, recording a conflict if it
+  // already holds a different action.
+  void setAction(uint32_t state, uint32_t t, Action action) {
+    Action& cell = actions[state][t];
+    if (cell.kind == Action::ERROR) {
+      cell = action;
+      return;
+    }
+    if (cell.kind == action.kind && cell.value == action.value) {
+      return;
+    }
+    const auto what = [&](Action a) {
+      switch (a.kind) {
+        case Action::SHIFT:
+          return "shifting to state " + std::to_string(a.value);
+        case Action::REDUCE:
+          return "reducing by " + describe(a.value);
+        default:
+          return std::string("accepting");
+      }
+    };
+    const bool shift =
+        cell.kind == Action::SHIFT || action.kind == Action::SHIFT;
+    conflicts.push_back("state " + std::to_string(state) + " on " +
+                        std::string(tables.terminals[t]) + ": " +
+                        (shift ? "shift/reduce" : "reduce/reduce") +
+                        " conflict between " + what(cell) + " and " +
+                        what(action));
+  }
+
+  void buildActions() {
+    actions.assign(states.size(), std::vector<Action>(terminals));
+    gotos.assign(states.size(), std::vector<uint32_t>(nonTerminals, NONE));
+    std::vector<Bitset> lookaheads;
+    Bitset reached;
+    for (uint32_t s = 0; s < states.size(); s++) {
+      const auto& state = states[s];
+      for (const auto& [symbol, to] : state.transitions) {
+        if (isNonTerminal(symbol)) {
+          gotos[s][symbol] = to;
+        } else {
+          setAction(s, terminal(symbol), {Action::SHIFT, to});
+        }
+      }
+
+      const auto reduce = [&](uint32_t production, const Bitset& lookahead) {
+        if (productions[production].left == start) {
+          setAction(s, end, {Action::ACCEPT, 0});
+          return;
+        }
+        lookahead.forEach([&](size_t t) {
+          setAction(s, static_cast<uint32_t>(t), {Action::REDUCE, production});
+        });
+      };
+      for (size_t k = 0; k < state.kernel.size(); k++) {
+        const Item item = state.kernel[k];
+        if (item.dot == productions[item.production].right.size()) {
+          reduce(item.production, state.lookaheads[k]);
+        }
+      }
+      closeLookaheads(state.kernel, state.lookaheads, lookaheads, reached);
+      reached.forEach([&](size_t nonTerminal) {
+        for (const auto p : productionsOf[nonTerminal]) {
+          if (productions[p].right.empty()) {
+            reduce(p, lookaheads[nonTerminal]);
+          }
+        }
+      });
+    }
+  }
+};
+
+// csvName returns the name of a symbol in the CSV files: non-terminals lose
+// their < and >.
+std::string csvName(std::string_view name) {
+  if (Grammar::isNonTerminal(std::string(name))) {
+    name = name.substr(1, name.size() - 2);
+  }
+  return std::string(name);
+}
+
+// checkDriver returns why the driver cannot run the tables of the automaton,
+// or an empty string if it can.
+std::string checkDriver(const automaton& lr) {
+  std::set<std::string> names;
+  for (uint32_t symbol = 0; symbol < lr.nonTerminals + lr.terminals; symbol++) {
+    if (symbol == lr.start ||
+        (!lr.isNonTerminal(symbol) &&
+         lr.tables.terminals[lr.terminal(symbol)] == LAMBDA)) {
+      continue;
+    }
+    const std::string name = csvName(lr.symbolName(symbol));
+    if (name.empty() || name.find(',') != std::string::npos ||
+        name == "State" || !names.insert(name).second) {
+      return lr.symbolName(symbol) + " cannot be a column of the table";
+    }
+  }
+  for (uint32_t p = 0; p + 1 < lr.productions.size(); p++) {
+    if (lr.productions[p].right.empty()) {
+      return lr.describe(p) + " derives λ, which the driver cannot reduce by";
+    }
+    for (const auto symbol : lr.productions[p].right) {
+      if (csvName(lr.symbolName(symbol)).size() != 1) {
+        return lr.describe(p) + " has " + lr.symbolName(symbol) +
+               ", which is not one character";
+      }
+    }
+  }
+  return "";
+}
+
+// writeTable writes the action and goto tables, with a column per terminal
+// other than λ, $ last among them, and then one per non-terminal.
+void writeTable(std::ostream& out, const automaton& lr) {
+  std::vector<uint32_t> terminals;
+  for (uint32_t t = 0; t < lr.terminals; t++) {
+    if (t != lr.end && lr.tables.terminals[t] != LAMBDA) {
+      terminals.push_back(t);
+    }
+  }
+  terminals.push_back(lr.end);
+
+  out << "State";
+  for (const auto t : terminals) {
+    out << ',' << lr.tables.terminals[t];
+  }
+  for (uint32_t n = 0; n < lr.start; n++) {
+    out << ',' << csvName(lr.tables.nonTerminals[n]);
+  }
+  out << '\n';
+  for (uint32_t s = 0; s < lr.states.size(); s++) {
+    out << s;
+    for (const auto t : terminals) {
+      const Action action = lr.actions[s][t];
+      out << ',';
+      switch (action.kind) {
+        case Action::SHIFT:
+          out << 'S' << action.value;
+          break;
+        case Action::REDUCE:
+          out << 'R' << action.value + 1;
+          break;
+        case Action::ACCEPT:
+          out << "ACC";
+          break;
+        case Action::ERROR:
+          break;
+      }
+    }
+    for (uint32_t n = 0; n < lr.start; n++) {
+      out << ',';
+      if (lr.gotos[s][n] != automaton::NONE) {
+        out << lr.gotos[s][n];
+      }
+    }
+    out << '\n';
+  }
+}
+
+// writeRules writes the grammar entries, which the driver numbers from 1.
+void writeRules(std::ostream& out, const automaton& lr) {
+  for (uint32_t p = 0; p + 1 < lr.productions.size(); p++) {
+    out << csvName(lr.symbolName(lr.productions[p].left)) << ',';
+    for (const auto symbol : lr.productions[p].right) {
+      out << csvName(lr.symbolName(symbol));
+    }
+    out << '\n';
+  }
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    std::cerr << "usage: " << argv[0] << " grammar_file table_file rules_file"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream grammarFile(argv[1]);
+  if (!grammarFile) {
+    std::cerr << "error: could not open " << argv[1] << std::endl;
+    return 1;
+  }
+  const Grammar grammar(grammarFile);
+  const auto tables = grammar.exportTables();
+  const automaton lr(tables);
+
+  for (const auto& conflict : lr.conflicts) {
+    std::cerr << "conflict: " << conflict << std::endl;
+  }
+  if (!lr.conflicts.empty()) {
+    std::cerr << "error: " << argv[1] << " is not LALR(1)" << std::endl;
+    return 1;
+  }
+  if (const auto problem = checkDriver(lr); !problem.empty()) {
+    std::cerr << "error: " << problem << std::endl;
+    return 1;
+  }
+
+  std::ofstream table(argv[2]);
+  std::ofstream rules(argv[3]);
+  if (!table || !rules) {
+    std::cerr << "error: could not create " << (table ? argv[3] : argv[2])
+              << std::endl;
+    return 1;
+  }
+  writeTable(table, lr);
+  writeRules(rules, lr);
+}
@@ -0,0 +1,268 @@
+// generate-parser writes a header with a recursive-descent parser of a grammar,
+// which parses programs like Parser::parse but with the parsing table compiled
+// into code:
+//
+//   generate-parser grammar.txt DescentParser > descent.hpp
+//
+// The header defines a Parser::Descent of the given class name, which is
+// constructed from a Parser of the same grammar. It has a function per
+// non-terminal that switches on the terminal of the next lexeme. Grammar
+// entries that end with the non-terminal they expand are parsed in a loop
+// instead of by recursion, so that long lists do not nest calls. Functions of
+// groups add to the node they are given instead of making one, and those of
+// expressions fold their node once it is parsed. Non-terminals with a lexical
+// rule first try to match it against the next word.
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../lib/grammar.hpp"
+#include "quote.hpp"
+
+namespace {
+// functionName returns the name of the function that parses a non-terminal:
+// <dec-list> is parsed by parseDecList.
+std::string functionName(std::string_view nonTerminal) {
+  std::string name = "parse";
+  bool upper = true;
+  for (const char c : nonTerminal) {
+    if (!std::isalnum(static_cast<unsigned char>(c))) {
+      upper = true;
+    } else if (upper) {
+      name += std::toupper(static_cast<unsigned char>(c));
+      upper = false;
+    } else {
+      name += c;
+    }
+  }
+  return name;
+}
+
+// writeNames writes a constexpr array of names as a member of the class.
+void writeNames(std::ostream& out, const std::string& name,
+                const std::vector<std::string_view>& names) {
+  out << "  static constexpr std::array<std::string_view, " << names.size()
+      << "> " << name << " = {\n";
+  for (const auto value : names) {
+    out << "      " << quote(value) << ",\n";
+  }
+  out << "  };\n";
+}
+
+class generator {
+ public:
+  generator(const Grammar::OwnedTables& tables,
+            const std::vector<Grammar::LexicalRule>& lexicalRules)
+      : tables(tables), groups(tables.groups.begin(), tables.groups.end()) {
+    for (const auto& rule : lexicalRules) {
+      lexical.insert(rule.nonTerminal);
+    }
+    for (size_t i = 0; i < tables.operators.size(); i += 3) {
+      expressions.insert(tables.operators[i]);
+    }
+    for (const auto name : tables.nonTerminals) {
+      std::string function = functionName(name);
+      if (!functions.insert(function).second) {
+        function += std::to_string(names.size());
+        functions.insert(function);
+      }
+      names.push_back(function);
+    }
+  }
+
+  void write(std::ostream& out, const std::string& className) {
+    out << "class " << className << " final : public Parser::Descent {\n"
+        << " public:\n"
+        << "  explicit " << className << "(const Parser& parser)\n"
+        << "      : Descent(parser, terminalNames, nonTerminalNames) {}\n\n"
+        << " private:\n";
+    writeNames(out, "terminalNames", tables.terminals);
+    writeNames(out, "nonTerminalNames", tables.nonTerminals);
+    out << "\n"
+        << "  void start(Node root) override { " << names[tables.lefts[0]]
+        << "(root); }\n";
+    for (size_t n = 0; n < tables.nonTerminals.size(); n++) {
+      out << "\n";
+      writeFunction(out, n);
+    }
+    out << "};\n";
+  }
+
+ private:
+  const Grammar::OwnedTables& tables;
+  std::vector<std::string> names;  // of the function of each non-terminal
+  std::set<std::string> functions;
+  std::set<std::string, std::less<>> lexical;  // with a lexical rule
+  std::set<size_t> groups;
+  std::set<size_t> expressions;
+
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  bool isNonTerminal(uint32_t symbol) const {
+    return symbol < tables.nonTerminals.size();
+  }
+
+  std::string_view symbolName(uint32_t symbol) const {
+    return isNonTerminal(symbol)
+               ? tables.nonTerminals[symbol]
+               : tables.terminals[symbol - tables.nonTerminals.size()];
+  }
+
+  // rightSide returns the symbols of a grammar entry without λ.
+  std::vector<uint32_t> rightSide(size_t production) const {
+    std::vector<uint32_t> symbols;
+    for (uint32_t i = tables.starts[production];
+         i < tables.starts[production + 1]; i++) {
+      if (symbolName(tables.rights[i]) != LAMBDA) {
+        symbols.push_back(tables.rights[i]);
+      }
+    }
+    return symbols;
+  }
+
+  // cell returns the grammar entry in a cell of the parsing table, or NONE.
+  uint32_t cell(size_t nonTerminal, size_t terminal) const {
+    const size_t i = tables.offsets[nonTerminal] + terminal;
+    if (!tables.checks.empty() &&
+        (i >= tables.checks.size() || tables.checks[i] != nonTerminal)) {
+      return NONE;
+    }
+    const auto production = tables.cells[i];
+    return production == Grammar::CompiledTable::ERROR ? NONE : production;
+  }
+
+  void writeFunction(std::ostream& out, size_t nonTerminal) {
+    // The terminals each grammar entry of the non-terminal is expanded on.
+    std::map<uint32_t, std::vector<size_t>> cases;
+    for (size_t t = 0; t < tables.terminals.size(); t++) {
+      const uint32_t production = cell(nonTerminal, t);
+      if (production != NONE) {
+        cases[production].push_back(t);
+      }
+    }
+
+    bool loops = false;
+    for (size_t p = 0; p < tables.lefts.size(); p++) {
+      if (tables.lefts[p] == nonTerminal) {
+        const auto right = rightSide(p);
+        loops |= !right.empty() && right.back() == nonTerminal;
+        out << "  // " << tables.nonTerminals[nonTerminal] << " ->";
+        for (uint32_t i = tables.starts[p]; i < tables.starts[p + 1]; i++) {
+          out << ' ' << symbolName(tables.rights[i]);
+        }
+        out << "\n";
+      }
+    }
+
+    const std::string indent = loops ? "    " : "  ";
+    const std::string symbol =
+        "nonTerminals[" + std::to_string(nonTerminal) + "]";
+    const bool group = groups.contains(nonTerminal);
+    out << "  void " << names[nonTerminal] << "(Node parent) {\n";
+    if (loops) {
+      out << "    for (;;) {\n";
+    }
+    if (lexical.contains(tables.nonTerminals[nonTerminal])) {
+      out << indent << "  if (scan(parent, " << symbol << ")) return;\n";
+    }
+    if (!group) {
+      out << indent << "  Node node;\n";
+    }
+    out << indent << "  switch (next()) {\n";
+    for (const auto& [production, terminals] : cases) {
+      for (const auto t : terminals) {
+        out << indent << "    case " << t << ":  // " << tables.terminals[t]
+            << "\n";
+        if (tables.terminals[t] == "$") {
+          out << indent << "    case END:\n";
+        }
+      }
+      writeCase(out, indent + "      ", symbol, nonTerminal, group,
+                rightSide(production));
+    }
+    out << indent << "    default:\n"
+        << indent << "      fail(" << symbol << ");\n"
+        << indent << "  }\n";
+    if (loops) {
+      out << "    }\n";
+    }
+    out << "  }\n";
+  }
+
+  // writeCase writes the code of a grammar entry. Groups add the symbols of
+  // their grammar entries to parent.
+  void writeCase(std::ostream& out, const std::string& indent,
+                 const std::string& symbol, size_t nonTerminal, bool group,
+                 std::vector<uint32_t> right) {
+    const bool loops = !right.empty() && right.back() == nonTerminal;
+    if (right.empty()) {
+      if (!group) {
+        out << indent << "expand(parent, " << symbol << ");\n";
+      }
+      out << indent << "return;\n";
+      return;
+    }
+
+    const std::string node = group ? "parent" : "node";
+    if (!group) {
+      out << indent << "node = expand(parent, " << symbol << ");\n";
+    }
+    if (loops) {
+      right.pop_back();
+    }
+    for (const auto s : right) {
+      if (isNonTerminal(s)) {
+        out << indent << names[s] << "(" << node << ");\n";
+      } else {
+        out << indent << "match(" << node << ", "
+            << s - tables.nonTerminals.size() << ");  // " << symbolName(s)
+            << "\n";
+      }
+    }
+    if (loops) {
+      if (!group) {
+        out << indent << "parent = node;\n";
+      }
+      out << indent << "continue;\n";
+    } else {
+      if (expressions.contains(nonTerminal)) {
+        out << indent << "fold(node);\n";
+      }
+      out << indent << "return;\n";
+    }
+  }
+};
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " grammar_file class_name"
+              << std::endl;
+    return 1;
+  }
+
+  std::ifstream grammarFile(argv[1]);
+  if (!grammarFile) {
+    std::cerr << "error: could not open " << argv[1] << std::endl;
+    return 1;
+  }
+  const Grammar grammar(grammarFile);
+  const auto tables = grammar.exportTables();
+
+  auto& out = std::cout;
+  out << "// Code generated by tools/generate-parser.cpp from " << argv[1]
+      << ". DO NOT EDIT.\n\n"
+      << "#pragma once\n\n"
+      << "#include <array>\n"
+      << "#include <string_view>\n\n"
+      << "#include \"lib/parser.hpp\"\n\n"
+      << "// " << argv[2] << " is a recursive-descent parser of " << argv[1]
+      << ".\n";
+  generator(tables, grammar.getLexicalRules()).write(out, argv[2]);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// quote returns a string as a C++ string literal. Bytes outside of printable
+// ASCII are escaped, so generated code is ASCII.
+inline std::string quote(std::string_view value) {
+  static const char digits[] = "01234567";
+  std::string out = "\"";
+  for (const unsigned char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c < ' ' || c > '~') {
+      // Octal escapes always have 3 digits, so they never take the next
+      // character along.
+      out += '\\';
+      out += digits[c >> 6];
+      out += digits[(c >> 3) & 7];
+      out += digits[c & 7];
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}